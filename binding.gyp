@@ -1,4 +1,7 @@
 {
+  "variables": {
+    "amrwb_encoder%": "<!(node -p \"require('fs').existsSync('lib/libvo-amrwbenc.a')\")"
+  },
   "targets": [
     {
       "target_name": "feng_ap",
@@ -14,21 +17,34 @@
       ],
       "sources": [
         "src/napi_module.cpp",
+        "src/napi_common.cpp",
         "src/napi_audiofile.cpp",
         "src/napi_ampfreq.cpp",
         "src/napi_pitch.cpp",
+        "src/pitch.cpp",
+        "src/parallel.cpp",
         "src/napi_fft.cpp",
         "src/napi_mfcc.cpp",
         "src/mfcc.cpp",
         "src/napi_amr.cpp",
         "src/amr.cpp",
         "src/minimp3.cpp",
+        "src/mp3.cpp",
         "src/napi_mp3.cpp",
+        "src/napi_probe.cpp",
+        "src/napi_file.cpp",
         "src/denoise.cpp",
         "src/napi_resample.cpp"
       ],
       "include_dirs": [
         "./include"
+      ],
+      "defines": [ "MINIMP3_FLOAT_OUTPUT" ],
+      "conditions": [
+        [ "amrwb_encoder=='true'", {
+          "defines": [ "HAVE_AMRWB_ENCODER" ],
+          "libraries": [ "../lib/libvo-amrwbenc.a" ]
+        } ]
       ]
     }
   ]
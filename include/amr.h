@@ -14,6 +14,7 @@
 #define _INCLUDE_AMR_H_
 
 #include <string.h>
+#include <vector>
 
 
 #define AMRNB_HEADER "#!AMR\n"
@@ -28,13 +29,219 @@ enum AMR_TYPE
 };
 
 
+// The invalid frames met while decoding, numbered from 1 (the return codes are their negatives).
+enum AMR_ERROR
+{
+  AMR_ERROR_NONE,
+  AMR_ERROR_SHORT_FRAME,      // no frame data, e.g., an empty packet
+  AMR_ERROR_BAD_TOC,          // the TOC list runs past the packet
+  AMR_ERROR_BAD_FRAME_TYPE,   // a reserved frame type
+  AMR_ERROR_SIZE_MISMATCH,    // the packet size does not match its TOC list
+  AMR_NB_ERRORS
+};
+
+// The number of invalid frames of each kind met since the module load (thread-safe).
+long getAMRErrorCount(enum AMR_ERROR error);
+
+
 enum AMR_TYPE getAMRType(char* data, int size);
 int getSampleCount(char* data, int size, enum AMR_TYPE type);
 
+// What is known about an AMR file without decoding it.
+struct AmrProbe
+{
+  enum AMR_TYPE type;
+  int sampleRate;
+  int nbFrames;
+  double durationMs;
+  int frameTypes[16]; // the number of frames of each type: the modes, then SID and NO_DATA (15).
+};
+
+// Walk the frame headers once, without any codec. Returns 0, or -1 if it is not AMR.
+int probeAMR(char* data, int size, AmrProbe &probe);
+
 short* amr2pcm(char* data, int size);
-char* pcm2amr(short* data, int size, int sampleRate, int* out_size, int mode);
-char* wav2amr(char* data, int size, int* out_size, int mode);
+// Decode 'count' AMR buffers on 'nbThreads' threads (0: one per core), one pooled decoder per buffer being decoded.
+// The samples of the i-th buffer are at [offsets[i], offsets[i+1]) of the returned buffer ('offsets' holds count+1 entries).
+// A buffer which is not AMR gets no samples and a sample rate of 0.
+short* amr2pcmBatch(char** data, int* sizes, int count, size_t* offsets, int* sampleRates, int nbThreads);
+
+// With 'dtx', the silence is sent as SID (comfort noise) and NO_DATA frames instead of the speech frames.
+char* pcm2amr(short* data, int size, int sampleRate, int* out_size, int mode, bool dtx = false);
+// Encode a long recording to AMR-NB on 'nbThreads' threads (0: one per core): it is split into chunks at the frame boundaries,
+// each encoded by its own encoder warmed up on the 'warmUp' frames before it, and the frames are concatenated.
+// The output is a valid AMR-NB file, though not bit-exact with pcm2amr() around the seams (see the README, and
+// amr_parallel_quality() in example.cpp for the measurement).
+#define AMR_ENCODE_WARM_UP    (10)    // frames (200 ms)
+#define AMR_ENCODE_MIN_CHUNK  (500)   // frames (10 s)
+char* pcm2amrParallel(short* data, int size, int sampleRate, int* out_size, int mode, bool dtx, int nbThreads, int warmUp = AMR_ENCODE_WARM_UP);
+// Encode to AMR-WB (mode 0: 6.60k ... 8: 23.85k), the input is resampled to 16 kHz if needed.
+// It needs the AMR-WB encoder (vo-amrwbenc), built in with HAVE_AMRWB_ENCODER. Returns NULL otherwise.
+char* pcm2amrwb(short* data, int size, int sampleRate, int* out_size, int mode);
+bool hasAMRWBEncoder();
+char* wav2amr(char* data, int size, int* out_size, int mode, bool dtx = false);
 char* mp32amr(short* data, int size, int* out_size, int mode);
 int amr_remove_silence(char* data, int size, float threshold, char** pOutput, int* szOutput);
 
+
+#define AMR_FRAME_MS        (20)
+#define AMR_PRE_ROLL        (25)    // the frames (500 ms) decoded before a range, so that the decoder state converges
+#define AMR_INDEX_STEP      (50)    // index one frame per second when the index is built on the fly
+#define AMR_TRIM_BLOCK      (100)   // the frames decoded at once (after a pre-roll) while looking for the trailing silence
+
+// The byte offset of every 'step'-th frame, to seek into a file without decoding it.
+struct AmrIndex
+{
+  enum AMR_TYPE type;
+  int size;                       // the size of the indexed file, to detect a mismatch.
+  int step;
+  int nbFrames;
+  std::vector<int> offsets;       // the offset of the frames 0, step, 2*step, ...
+};
+
+// Walk the frame headers only. Returns 0 on success, or -1 if it is not AMR.
+int buildAMRIndex(char* data, int size, int step, AmrIndex &index);
+
+// Decode the samples within [startMs, endMs). The decoding starts 'preRoll' frames earlier (dropped).
+// Returns NULL if the index does not match the data or the range is empty.
+short* amrDecodeRange(char* data, int size, const AmrIndex &index, double startMs, double endMs, int preRoll, int* nbSamples);
+
+// Save the index as bytes (little-endian), e.g., to cache it next to the file, and load it back.
+char* serializeAMRIndex(const AmrIndex &index, int* out_size);
+int deserializeAMRIndex(const char* data, int size, AmrIndex &index);
+
+
+// A run of whole frames of an AMR file, i.e., the bytes [start, end) of 'data', copied as is.
+struct AmrFrames
+{
+  enum AMR_TYPE type;
+  char* data;
+  int start;
+  int end;
+};
+
+// Select the frames within [startMs, endMs), both rounded to the closest frame boundary (20 ms).
+// Returns 0 on success, or -1 if it is not AMR.
+int selectAMRFrames(char* data, int size, double startMs, double endMs, AmrFrames &frames);
+// Write the header and the frames back to back into 'output' (NULL to only get the size).
+// Returns the size, or -1 if the frames are not all of the same type.
+int writeAMRFrames(const std::vector<AmrFrames> &frames, char* output);
+
+// Edit the AMR data without transcoding. Each returns the new AMR data, allocated once, or NULL if invalid.
+char* amr_concat(char** data, int* sizes, int count, int* out_size);
+char* amr_cut(char* data, int size, double startMs, double endMs, int* out_size);
+// Replace the frames within [startMs, endMs) with all the frames of 'insert' (startMs == endMs to insert only).
+char* amr_splice(char* data, int size, double startMs, double endMs, char* insert, int szInsert, int* out_size);
+
+// The RTP payload (RFC 4867, octet-aligned, one channel) of 'n' frames is at most this long: the CMR, then the TOC and the data of each frame.
+#define AMR_RTP_MAX_PAYLOAD(n)  (1 + (n) * AMR_MAX_FRAME_BYTES)
+
+// Pack the next frames of the AMR file from '*position' (0 to start) into one RTP payload, written to 'payload'.
+// It holds up to 'framesPerPacket' frames, fewer at the end or if 'capacity' is short. Nothing is allocated.
+// Returns the payload size and moves '*position' past its frames, or -1 if invalid.
+// Returns 0 if no frame fits, or if no frame is left, then '*position' is set to 'size'.
+int amrPacketize(char* data, int size, int* position, int framesPerPacket, char* payload, int capacity);
+// Unpack an RTP payload into the frames of the AMR file (without the header), written to 'output'. Nothing is allocated.
+// Returns the size written (payload size - 1), 0 if 'capacity' is short, or negative (-AMR_ERROR_*) if invalid.
+int amrDepacketize(const char* payload, int size, enum AMR_TYPE type, char* output, int capacity);
+
+// The codec contexts are pooled: they are reset and reused instead of being freed.
+#define AMR_POOL_SIZE       (16)    // the idle contexts kept per codec
+#define AMR_POOL_WARM_UP    (4)     // the contexts created per codec at the module load
+
+// Thread-safe. The AMR-WB encoder is NULL unless it is built in (HAVE_AMRWB_ENCODER).
+void* acquireAMRDecoder(enum AMR_TYPE type);
+void releaseAMRDecoder(void* decoder, enum AMR_TYPE type);
+// The AMR-NB encoders with and without the DTX are pooled apart. The AMR-WB encoder is not pooled (it has no reset).
+void* acquireAMREncoder(enum AMR_TYPE type = AMR_NB, bool dtx = false);
+void releaseAMREncoder(void* encoder, enum AMR_TYPE type = AMR_NB, bool dtx = false);
+
+// Keep at most 'size' idle contexts per codec (the extra ones are freed).
+void setAMRPoolSize(int size);
+// Create the contexts up front, so that they are not allocated on the first calls.
+void warmUpAMRPool(int count);
+
+#define AMR_MAX_FRAME_BYTES (61)    // TOC + the longest payload (AMR-WB 23.85k)
+#define AMRNB_FRAME_SAMPLES (160)   // the samples of a 20 ms frame at 8 kHz
+
+// Decode an AMR NB/WB stream chunk by chunk.
+// The header and the frames could be split at any byte, the incomplete frame is kept until the next chunk.
+// Each frame (20 ms) is decoded as soon as its last byte arrives, no pre-scan is needed.
+class AmrDecoder
+{
+
+public:
+
+  AmrDecoder();
+  virtual ~AmrDecoder();
+
+  // Feed a chunk of any length. The decoded samples are appended to 'pcm'.
+  // Returns 0 on success, or negative if the stream is not AMR or a frame is invalid.
+  // Once it failed, every call fails until reset().
+  int process(const char* data, size_t length, std::vector<short> &pcm);
+
+  // Forget the stream (and the incomplete frame), so that the decoder could be reused.
+  void reset();
+
+  enum AMR_TYPE getType() { return m_type; };
+  int getSampleRate() { return (m_type==AMR_NB) ? 8000 : ( (m_type==AMR_WB) ? 16000 : 0 ); };
+
+private:
+
+  int parseHeader(const char* data, size_t length, size_t* consumed);
+  int decodeFrame(const char* frame, int frameBytes, std::vector<short> &pcm);
+
+private:
+
+  enum AMR_TYPE m_type;
+  void* m_decoder;
+
+  char m_pending[AMR_MAX_FRAME_BYTES]; // the header or the frame split over the chunks.
+  int m_nbPending;
+  bool m_isInvalid; // the stream failed, the pending bytes are not trusted anymore.
+};
+
+
+#define AMR_ENCODER_BLOCK   (1024)  // the resampled samples produced at once
+
+// Encode a PCM stream of any sample rate to AMR-NB, chunk by chunk.
+// The chunks are resampled to 8 kHz on the fly (the resampler keeps its state across the chunks),
+// and each complete 160-sample block is encoded right away. The memory does not grow with the stream.
+class AmrEncoder
+{
+
+public:
+
+  AmrEncoder(int sampleRate, int mode);
+  virtual ~AmrEncoder();
+
+  // Feed a chunk of samples within [-1, 1]. The AMR bytes (the header first) are appended to 'amr'.
+  // Returns 0 on success, or negative if the resampling failed.
+  int process(const float* data, size_t length, std::vector<char> &amr);
+
+  // End of the stream: drain the resampler and encode the last block padded with zeros.
+  // The encoder is then reset, so that it could be reused for another stream.
+  int flush(std::vector<char> &amr);
+
+  void reset();
+
+private:
+
+  int resample(const float* data, size_t length, bool isLast, std::vector<char> &amr);
+  void addSamples(const float* data, size_t length, std::vector<char> &amr);
+  void encodeBlock(std::vector<char> &amr);
+
+private:
+
+  int m_sampleRate;
+  int m_mode;
+  void* m_encoder;
+  struct SRC_STATE_tag* m_resampler;  // NULL if the input is already at 8 kHz.
+  bool m_isStarted;                   // the header has been written.
+
+  float m_resampled[AMR_ENCODER_BLOCK];
+  short m_block[AMRNB_FRAME_SAMPLES];
+  int m_nbBlock;
+};
+
 #endif // #ifndef _INCLUDE_AMR_H_
@@ -53,7 +53,11 @@
 #define MINIMP3_MAX(a, b)           ((a) < (b) ? (b) : (a))
 
 
+#ifndef MINIMP3_FLOAT_OUTPUT
 typedef int16_t mp3d_sample_t;
+#else /* MINIMP3_FLOAT_OUTPUT */
+typedef float mp3d_sample_t;
+#endif /* MINIMP3_FLOAT_OUTPUT */
 
 typedef struct
 {
@@ -65,7 +69,7 @@ typedef struct
 typedef struct
 {
     mp3d_sample_t *buffer;
-    size_t samples; /* channels included, byte size = samples*sizeof(int16_t) */
+    size_t samples; /* channels included, byte size = samples*sizeof(mp3d_sample_t) */
     int channels, hz, layer, avg_bitrate_kbps;
 } mp3dec_file_info_t;
 
@@ -80,6 +84,19 @@ typedef struct
     int frame_bytes, channels, hz, layer, bitrate_kbps;
 } mp3dec_frame_info_t;
 
+#define MP3D_TAG_NONE               0
+#define MP3D_TAG_XING               1 /* Xing or Info */
+#define MP3D_TAG_VBRI               2
+
+typedef struct
+{
+    size_t frames, samples; /* the audio frames, and their samples per channel (the tag frame excluded) */
+    int channels, hz, layer, vbr_tag;
+    size_t tag_frames; /* the frame count of the Xing/VBRI tag, 0 if unknown */
+    unsigned bitrate_kbps[16]; /* per bitrate index of the header, 0 for the free format */
+    size_t bitrate_frames[16];
+} mp3dec_probe_info_t;
+
 typedef struct
 {
     const uint8_t *buf;
@@ -119,8 +136,42 @@ typedef int (*MP3D_ITERATE_CB)(void *user_data, const uint8_t *frame, int frame_
 typedef int (*MP3D_PROGRESS_CB)(void *user_data, size_t file_size, size_t offset, mp3dec_frame_info_t *info);
 
 void mp3dec_init(mp3dec_t *dec);
+/* The size of the ID3v2 tag at the start of the buffer (header included), 0 if none. */
+size_t mp3dec_skip_id3v2(const uint8_t *buf, size_t buf_size);
 void mp3dec_load_buf(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3dec_file_info_t *info, MP3D_PROGRESS_CB progress_cb, void *user_data);
+/* Decode as mp3dec_load_buf(), but into 'pcm' that holds 'max_samples' (channels included), e.g., sized by mp3dec_count_samples().
+   Returns 0, or -1 if a frame does not fit: 'info' then holds the samples decoded before it. */
+int mp3dec_load_buf_into(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3d_sample_t *pcm, size_t max_samples, mp3dec_file_info_t *info);
 int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info);
+/* The SSE2/NEON paths are chosen at run time (CPUID on x86, AT_HWCAP on Linux/ARM), unless built with MINIMP3_NO_SIMD.
+   Select them (enable = 1, the default) or the scalar ones (enable = 0) for all decoders, e.g., to compare.
+   Returns 1 if the SIMD paths are used from now on. Not thread-safe: call it before decoding. */
+int mp3dec_simd_enable(int enable);
+#ifdef MINIMP3_FLOAT_OUTPUT
+/* Round as the 16-bit output does, so that the result is the same as without MINIMP3_FLOAT_OUTPUT. */
+void mp3dec_f32_to_s16(const float *in, int16_t *out, size_t num_samples);
+#endif /* MINIMP3_FLOAT_OUTPUT */
+
+/* Call 'callback' for each frame mp3dec_load_buf() decodes (the tag frame included), without decoding: only the headers are read.
+   The offset is from 'buf'. Returns 0, or the non-zero value of the callback that stopped the walk. */
+int mp3dec_iterate_buf(const uint8_t *buf, size_t buf_size, MP3D_ITERATE_CB callback, void *user_data);
+/* Resume the walk at 'offset', a frame found by an earlier walk: the offsets are still from 'buf'. */
+int mp3dec_iterate_buf_from(const uint8_t *buf, size_t buf_size, size_t offset, MP3D_ITERATE_CB callback, void *user_data);
+/* The samples per channel of the frame. */
+int mp3dec_frame_samples(const uint8_t *hdr);
+
+/* Walk the frame headers only: no PCM, no decoder. Returns 0, or -1 if no frame is found. */
+int mp3dec_probe_buf(const uint8_t *buf, size_t buf_size, mp3dec_probe_info_t *info);
+/* The samples (channels included) mp3dec_load_buf() outputs, from one scan of the headers: exact, but for the frames
+   the decoder drops (a missing bit reservoir), or a corrupted stream. 0 if no frame is found. */
+size_t mp3dec_count_samples(const uint8_t *buf, size_t buf_size);
+
+/* Map the file read-only, with all its pages read in up front (as mp3dec_load() does). Returns 0, or -1 if it cannot be mapped. */
+int mp3dec_open_file(const char *file_name, mp3dec_map_info_t *map_info);
+/* Same, but the pages are read as they are touched, with a sequential read-ahead. Falls back to
+   mp3dec_open_file()'s mapping if the kernel refuses the hint. */
+int mp3dec_open_file_lazy(const char *file_name, mp3dec_map_info_t *map_info);
+void mp3dec_close_file(mp3dec_map_info_t *map_info);
 
 int mp3dec_load(mp3dec_t *dec, const char *file_name, mp3dec_file_info_t *info, MP3D_PROGRESS_CB progress_cb, void *user_data);
 
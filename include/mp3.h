@@ -0,0 +1,125 @@
+/*************************************************
+ *
+ * Decode the MP3 data.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#ifndef _INCLUDE_MP3_H_
+#define _INCLUDE_MP3_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "minimp3.h"
+
+
+// The bytes kept ahead of the frame being decoded, enough for the sync to check MAX_FRAME_SYNC_MATCHES frames.
+#define MP3_STREAM_LOOKAHEAD  (16*MAX_FREE_FORMAT_FRAME_SIZE)
+
+// Split the stream into segments of at least MP3_DECODE_MIN_SEGMENT frames to decode them in parallel.
+#define MP3_DECODE_MIN_SEGMENT  200
+
+// A frame of the stream, as mp3dec_load_buf() finds it.
+struct Mp3Frame
+{
+  size_t offset;  // from the start of the buffer (the ID3v2 tag included).
+  int size;
+  int samples;    // per channel.
+};
+
+// Find the frames, from their headers only (no decoding). 'info' gets the rate, layer and channels of the first one.
+void scanMp3Frames(const uint8_t* data, size_t length, std::vector<Mp3Frame> &frames, mp3dec_frame_info_t* info = NULL);
+
+// Decode as mp3dec_load_buf() into 'pcm' (sized by mp3dec_count_samples()), the segments on 'nbThreads' threads (0: one per core).
+// Each segment is preceded by enough frames to fill the bit reservoir and the filter banks, whose output is dropped,
+// so the samples are the same as the serial decoding. Returns 0, or -1 if 'pcm' is too small.
+int decodeMp3Parallel(const uint8_t* data, size_t length, mp3d_sample_t* pcm, size_t maxSamples, int nbThreads, mp3dec_file_info_t* info);
+
+// Decode the whole MP3 data into a buffer allocated by malloc() and sized by mp3dec_count_samples(),
+// in parallel as decodeMp3Parallel() if 'nbThreads' is not 1. A corrupted stream, where the decoder finds more frames
+// than the scan, is decoded again into a growing buffer. 'info' is set as mp3dec_load_buf() does; 'info->buffer' is NULL if no sample.
+void decodeMp3(const uint8_t* data, size_t length, int nbThreads, mp3dec_file_info_t* info);
+
+
+
+#define MP3_PRE_ROLL    (50)    // the frames walked back before a range to fill the bit reservoir (the low bit rates need the most)
+#define MP3_INDEX_STEP  (40)    // index one frame per second (about) when the index is built on the fly
+
+// The byte offset of every 'step'-th frame, to seek into a file without decoding it.
+// The walk stops at a change of the rate or the layer, as the decoder does, so all the frames have the same samples:
+// the frame k starts at the sample k * frameSamples.
+struct Mp3Index
+{
+  size_t size;                    // the size of the indexed file, to detect a mismatch.
+  int step;
+  int nbFrames;                   // the tag frame (Xing/VBRI) included, as it is decoded as silence.
+  int frameSamples;               // per channel.
+  int sampleRate;
+  int channels;
+  std::vector<uint32_t> offsets;  // the offset of the frames 0, step, 2*step, ...
+};
+
+// Walk the frame headers only. Returns 0 on success, or -1 if no frame is found.
+int buildMp3Index(const uint8_t* data, size_t length, int step, Mp3Index &index);
+
+// Decode the samples (interleaved) within [startMs, endMs). The frames before the range are decoded first (dropped)
+// until their main data fill the bit reservoir, walking back 'preRoll' frames at most.
+// Returns -1 if the index does not match the data. The samples are empty if the range is.
+int mp3DecodeRange(const uint8_t* data, size_t length, const Mp3Index &index, double startMs, double endMs, int preRoll, std::vector<mp3d_sample_t> &pcm);
+
+// Save the index as bytes (little-endian), e.g., to cache it next to the file, and load it back.
+char* serializeMp3Index(const Mp3Index &index, int* out_size);
+int deserializeMp3Index(const char* data, int size, Mp3Index &index);
+
+
+// Decode an MP3 stream chunk by chunk, with a constant memory.
+// The frames could be split at any byte: the bytes are kept until MP3_STREAM_LOOKAHEAD more bytes are known,
+// so that the frames are found exactly as mp3dec_load_buf() finds them on the whole buffer.
+class Mp3Decoder
+{
+
+public:
+
+  // The samples are emitted by blocks of 'blockSamples' samples per channel (0: as soon as each frame is decoded).
+  Mp3Decoder(int blockSamples = 0);
+  virtual ~Mp3Decoder();
+
+  // Feed a chunk of any length. The samples (interleaved, in [-1, 1)) of the completed blocks are appended to 'pcm'.
+  void process(const uint8_t* data, size_t length, std::vector<float> &pcm);
+
+  // End of the stream: decode the frames left and emit the last (partial) block. Call reset() before another stream.
+  void flush(std::vector<float> &pcm);
+
+  // Forget the stream, so that the decoder could be reused.
+  void reset();
+
+  int getSampleRate() { return m_sampleRate; };
+  int getChannels() { return m_channels; };
+
+private:
+
+  // Decode the buffered frames, all of them if 'isLast'.
+  void decode(bool isLast, std::vector<float> &pcm);
+
+private:
+
+  mp3dec_t m_decoder;
+  int m_blockSamples;
+  int m_sampleRate;
+  int m_channels;
+
+  bool m_isStarted;                // the ID3v2 tag has been checked.
+  size_t m_skip;                   // the bytes of the ID3v2 tag still to skip.
+  std::vector<uint8_t> m_pending;  // the bytes not decoded yet, from m_start.
+  size_t m_start;
+  std::vector<float> m_block;      // the samples of the incomplete block.
+};
+
+#endif // #ifndef _INCLUDE_MP3_H_
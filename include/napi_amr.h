@@ -16,9 +16,33 @@
 #include <node_api.h>
 
 napi_value amr2pcm(napi_env env, napi_callback_info args);
+napi_value amr2pcmBatch(napi_env env, napi_callback_info args);
+napi_value amrIndex(napi_env env, napi_callback_info args);
+napi_value amrDecodeRange(napi_env env, napi_callback_info args);
 napi_value pcm2amr(napi_env env, napi_callback_info args);
+napi_value pcm2amrwb(napi_env env, napi_callback_info args);
 napi_value wav2amr(napi_env env, napi_callback_info args);
 //napi_value mp32amr(napi_env env, napi_callback_info args);
 napi_value amr_remove_silence(napi_env env, napi_callback_info args);
+napi_value amrConcat(napi_env env, napi_callback_info args);
+napi_value amrCut(napi_env env, napi_callback_info args);
+napi_value amrSplice(napi_env env, napi_callback_info args);
+napi_value amrPacketize(napi_env env, napi_callback_info args);
+napi_value amrDepacketize(napi_env env, napi_callback_info args);
+napi_value configureAmrPool(napi_env env, napi_callback_info args);
+napi_value amrFrameErrors(napi_env env, napi_callback_info args);
+
+// Define the 'AmrDecoder' class, which decodes an AMR NB/WB stream chunk by chunk.
+// new AmrDecoder()
+//   .process(amrdata): Float32Array of the frames completed by this chunk
+//   .flush(): drop the incomplete frame and get ready for another stream
+//   .samplerate: 8000 or 16000, set once the header is known
+napi_value defineAmrDecoder(napi_env env);
+
+// Define the 'AmrEncoder' class, which resamples and encodes a PCM stream to AMR-NB chunk by chunk.
+// new AmrEncoder(sampleRate, mode)
+//   .process(pcmdata): Buffer of the AMR frames completed by this chunk (the header first)
+//   .flush(): Buffer of the last frames, then get ready for another stream
+napi_value defineAmrEncoder(napi_env env);
 
 #endif // #ifndef _NAPI_AMR_INCLUDED_H_
@@ -14,7 +14,50 @@
 #define _NAPI_COMMON_INCLUDED_H_
 
 #include <node_api.h>
+#include <vector>
 
 void throwException(napi_env env, const char* error);
 
+// Read the named option from an optional 'options' object.
+// The value is left untouched if 'options' is not an object or does not have the option.
+// Returns false if the option is there but has the wrong type.
+bool getOptionBool(napi_env env, napi_value options, const char* name, bool* value);
+bool getOptionInt32(napi_env env, napi_value options, const char* name, int32_t* value);
+bool getOptionDouble(napi_env env, napi_value options, const char* name, double* value);
+
+
+// A job run on a worker thread of the libuv pool, so that the event loop is not blocked,
+// which then settles its promise on the JS thread.
+class AsyncTask
+{
+
+public:
+
+  virtual ~AsyncTask() {};
+
+  // Worker thread: must not call any napi function. Set m_error on failure.
+  virtual void execute() = 0;
+
+  // JS thread: create the value to resolve the promise with, nullptr on failure.
+  virtual napi_value complete(napi_env env) = 0;
+
+  // Keep the JS value (e.g., a buffer read by execute()) alive until the promise is settled.
+  // On failure, the task is not executed and its promise is rejected.
+  bool keep(napi_env env, napi_value value);
+
+  const char* m_error = NULL;
+
+  napi_async_work m_work = NULL;
+  napi_deferred m_deferred = NULL;
+  std::vector<napi_ref> m_references;
+};
+
+// Queue the task and return its promise. The task is deleted once the promise is settled.
+// Throws and returns nullptr if it could not be queued (the task is deleted as well).
+napi_value queueAsyncTask(napi_env env, const char* name, AsyncTask* task);
+
+// Hand a buffer allocated by malloc() over to a new ArrayBuffer, which frees it once collected.
+// Some runtimes do not allow the external buffers: it is then copied and freed. Returns nullptr on failure (freed too).
+napi_value createArrayBufferFrom(napi_env env, void* data, size_t byteLength);
+
 #endif // #ifndef _NAPI_COMMON_INCLUDED_H_
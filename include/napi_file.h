@@ -0,0 +1,21 @@
+/*************************************************
+ *
+ * Decode the AMR and MP3 files on a worker thread.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#ifndef _NAPI_FILE_INCLUDED_H_
+#define _NAPI_FILE_INCLUDED_H_
+
+#include <node_api.h>
+
+napi_value mp32pcmFile(napi_env env, napi_callback_info args);
+napi_value amr2pcmFile(napi_env env, napi_callback_info args);
+
+#endif // #ifndef _NAPI_FILE_INCLUDED_H_
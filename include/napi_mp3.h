@@ -16,5 +16,14 @@
 #include <node_api.h>
 
 napi_value mp32pcm(napi_env env, napi_callback_info args);
+napi_value mp3Index(napi_env env, napi_callback_info args);
+napi_value mp3DecodeRange(napi_env env, napi_callback_info args);
+
+// Define the 'Mp3Decoder' class, which decodes an MP3 stream chunk by chunk with a constant memory.
+// new Mp3Decoder({ block: samples per channel, 0 to emit each frame })
+//   .process(mp3data): Float32Array of the blocks completed by this chunk
+//   .flush(): Float32Array of the rest of the stream, then get ready for another stream
+//   .samplerate, .channels: set once the first frame is decoded
+napi_value defineMp3Decoder(napi_env env);
 
 #endif // #ifndef _NAPI_MP3_INCLUDED_H_
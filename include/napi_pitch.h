@@ -19,6 +19,28 @@
 // arg[0]: wavdata (a single channel vector<float>)
 // arg[1]: sample rate
 // arg[2]: method  (available choices: acorr, yin, mpm, goertzel, dft)
+// arg[3]: options (optional) { decimate: false, minF0: 0, maxF0: 1000 }
 napi_value detectPitch(napi_env env, napi_callback_info args);
 
+// Detect the pitch of many mono-channel clips in parallel.
+// arg[0]: clips (an array of Float32Array, or one Float32Array holding all the clips back to back)
+// arg[1]: sample rate
+// arg[2]: method  (available choices: acorr, yin, mpm, goertzel, dft)
+// arg[3]: options (optional) { offsets, threads, decimate, minF0, maxF0 }
+napi_value detectPitchBatch(napi_env env, napi_callback_info args);
+
+// Detect the pitch with several methods in one pass over the mono-channel audio.
+// arg[0]: wavdata (a single channel vector<float>)
+// arg[1]: sample rate
+// arg[2]: methods (optional, an array of: acorr, yin, mpm. All of them by default)
+// arg[3]: options (optional) { minF0: 0, maxF0: 1000 }
+napi_value detectPitchEnsemble(napi_env env, napi_callback_info args);
+
+// Define the 'PitchTracker' class, which tracks the pitch of a stream chunk by chunk.
+// new PitchTracker(sampleRate, { frame: 40, hop: 10, lookahead: 2 })
+//   .process(wavdata): Float64Array of the F0 emitted per hop (-1 if unvoiced)
+//   .flush(): Float64Array of the remaining F0
+//   .latency: the delay in ms between the center of a frame and its F0
+napi_value definePitchTracker(napi_env env);
+
 #endif // #ifndef _NAPI_PITCH_INCLUDED_H_
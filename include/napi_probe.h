@@ -0,0 +1,20 @@
+/*************************************************
+ *
+ * Probe the AMR and MP3 data without decoding.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#ifndef _NAPI_PROBE_INCLUDED_H_
+#define _NAPI_PROBE_INCLUDED_H_
+
+#include <node_api.h>
+
+napi_value probe(napi_env env, napi_callback_info args);
+
+#endif // #ifndef _NAPI_PROBE_INCLUDED_H_
@@ -0,0 +1,29 @@
+/*************************************************
+ *
+ * Run independent tasks on several threads.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-18
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#ifndef _INCLUDE_PARALLEL_H_
+#define _INCLUDE_PARALLEL_H_
+
+#include <functional>
+#include <stddef.h>
+
+
+// The number of hardware threads (at least 1).
+int getThreadCount();
+
+// Run task(i) for each i in [0, count) on at most 'nbThreads' threads (0: one per hardware thread).
+// The tasks are handed out one by one, so that the long ones do not hold up a whole worker.
+// The calling thread takes part, the others come from a pool of threads kept between the calls.
+// It could be called from several threads at once (e.g., the libuv workers).
+void parallelFor(size_t count, int nbThreads, const std::function<void(size_t)> &task);
+
+#endif // #ifndef _INCLUDE_PARALLEL_H_
@@ -0,0 +1,204 @@
+/*************************************************
+ *
+ * Pitch estimation on a shared autocorrelation.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-18
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#ifndef _INCLUDE_PITCH_H_
+#define _INCLUDE_PITCH_H_
+
+#include <complex>
+#include <vector>
+
+#include "ffts.h"
+
+
+// The estimators that could be derived from one autocorrelation (bit mask).
+#define PITCH_METHOD_ACORR  (1)
+#define PITCH_METHOD_YIN    (2)
+#define PITCH_METHOD_MPM    (4)
+#define PITCH_METHOD_ALL    (PITCH_METHOD_ACORR | PITCH_METHOD_YIN | PITCH_METHOD_MPM)
+
+// The default F0 search range, in Hz.
+#define PITCH_MIN_FREQUENCY (0)    // 0: only bounded by the frame length.
+#define PITCH_MAX_FREQUENCY (1000)
+
+// Index of each estimator in the 'pitches' arrays.
+enum PITCH_INDEX
+{
+  PITCH_IDX_ACORR,
+  PITCH_IDX_YIN,
+  PITCH_IDX_MPM,
+  PITCH_NB_METHODS
+};
+
+// Convert the method name (acorr, yin, mpm) to its bit. Returns 0 if unknown.
+int getPitchMethod(const char* methodName);
+
+// The frame length holding two periods of the lowest F0.
+int getFrameLengthForF0(int sampleRate, double minF0);
+
+// The frame length of computePitchEnsemble(). Less than 2 if the sample rate is too low.
+int getEnsembleFrameLength(int sampleRate, double minF0 = PITCH_MIN_FREQUENCY);
+
+
+// A pitch candidate of one frame, i.e., a key maximum of the NSDF.
+struct PitchCandidate
+{
+  double pitch;
+  double clarity; // the NSDF value in [0, 1].
+};
+
+
+class PitchAnalyzer
+{
+
+public:
+
+  // Only the lags of the F0 within [minF0, maxF0] are searched.
+  PitchAnalyzer(int frameLength, int sampleRate, double minF0 = PITCH_MIN_FREQUENCY, double maxF0 = PITCH_MAX_FREQUENCY);
+  virtual ~PitchAnalyzer();
+
+  // NOTE: The frame length is fixed to 'frameLength'.
+  // The estimates are written to pitches[PITCH_IDX_*], -1 if unvoiced or not requested.
+  void analyze(const float* frame, int methods, double* pitches);
+
+  // Collect all the pitch candidates of the frame (the key maxima of the NSDF).
+  void getCandidates(const float* frame, std::vector<PitchCandidate> &candidates);
+
+  // Fuse the per-method estimates of one frame (median of the voiced ones).
+  static double fuse(const double* pitches);
+
+  int getFrameLength() { return m_frameLength; };
+
+private:
+
+  // Compute the autocorrelation and the energy prefix sums of the frame.
+  void computeAutocorrelation(const float* frame);
+
+  double pitchAutocorrelation();
+  double pitchYin();
+  double pitchMpm();
+
+  // Compute the NSDF into m_work and collect its key maxima.
+  void computeNsdf();
+  void findKeyMaxima(std::vector<int> &maxima);
+
+  // Refine the lag with the parabolic interpolation around 'tau'.
+  double parabolicLag(const std::vector<double> &values, int tau);
+
+  // Convert the lag to the F0, -1 if it falls out of the search range.
+  double lagToPitch(double lag);
+
+private:
+
+  int m_frameLength;
+  int m_sampleRate;
+  int m_fftSize;
+  int m_minLag;
+  int m_maxLag;
+  double m_minF0;
+  double m_maxF0;
+
+  ffts_plan_t* m_fftForward = NULL;
+  ffts_plan_t* m_fftBackward = NULL;
+
+  std::vector<std::complex<float>> m_signal;
+  std::vector<std::complex<float>> m_spectrum;
+
+  std::vector<double> m_acf;     // r(tau), tau = 0 .. maxLag+1
+  std::vector<double> m_energy;  // e(k) = x[0]^2 + ... + x[k-1]^2
+  std::vector<double> m_work;
+  std::vector<int> m_maxima;
+};
+
+
+struct PitchEnsemble
+{
+  double pitches[PITCH_NB_METHODS]; // the mean pitch of each method, -1 if not requested.
+  double pitch;                     // the mean of the fused per-frame pitch.
+};
+
+// Frame the audio once (40 ms per frame, 20 ms as the overlap) and run all requested methods on each frame.
+// If 'minF0' is set, the frame holds two periods of the lowest F0 instead.
+// The pitch of a method is -1 if none of the frames is voiced (or the clip is shorter than a frame).
+// NOTE: detectPitch() runs the same kernels on the same frames, one method at a time.
+PitchEnsemble computePitchEnsemble(const float* wavData, size_t length, int sampleRate, int methods,
+                                   double minF0 = PITCH_MIN_FREQUENCY, double maxF0 = PITCH_MAX_FREQUENCY);
+
+
+// The integer factor that brings the sample rate down to about 'targetRate' (at least 1).
+int getDecimationFactor(int sampleRate, int targetRate = 8000);
+
+// Low-pass filter (windowed-sinc FIR) and keep one sample every 'factor' samples.
+// Only the kept samples are filtered, i.e., the polyphase form of the decimator.
+std::vector<double> decimate(const std::vector<double> &data, int factor);
+
+// Refine a pitch estimated at a lower rate: search the best NSDF lag of the full-rate frame
+// within +/- 'radius' samples around the lag of 'pitch'. Returns -1 if 'pitch' is not positive.
+double refinePitch(const double* frame, int frameLength, int sampleRate, double pitch, int radius);
+
+
+// Track the pitch of a stream chunk by chunk.
+// One F0 is emitted per hop (-1 if unvoiced), once 'lookahead' more frames are known
+// to smooth the track with the Viterbi algorithm over the NSDF candidates.
+class PitchTracker
+{
+
+public:
+
+  // NOTE: The frame must hold at least 2 samples and the hop 1, see getTrackerLength().
+  PitchTracker(int sampleRate, int msFrame = 40, int msHop = 10, int lookahead = 2);
+  virtual ~PitchTracker();
+
+  // Feed a chunk of any length. The emitted F0s are appended to 'pitches'.
+  void process(const float* data, size_t length, std::vector<double> &pitches);
+
+  // End of the stream: emit the F0s still waiting for their lookahead.
+  void flush(std::vector<double> &pitches);
+
+  // Forget the stream, so that the tracker could be reused.
+  void reset();
+
+  // The delay between the center of a frame and the emission of its F0.
+  double getLatencyMs() { return 1000.0 * ( m_frameLength / 2 + m_lookahead * m_hopLength ) / m_sampleRate; };
+  int getHopLength() { return m_hopLength; };
+
+  // The number of samples of 'ms' milliseconds, as the frame and the hop are sized.
+  static int getTrackerLength(int sampleRate, int ms);
+
+private:
+
+  struct TrellisFrame
+  {
+    std::vector<PitchCandidate> candidates; // the last one is always the unvoiced state.
+    std::vector<double> costs;              // the accumulated cost of each candidate.
+    std::vector<int> backPointers;          // the best previous candidate.
+  };
+
+  void addFrame(const float* frame);
+  double emitOldest();
+
+  double transitionCost(const PitchCandidate &from, const PitchCandidate &to);
+
+private:
+
+  int m_sampleRate;
+  int m_frameLength;
+  int m_hopLength;
+  int m_lookahead;
+
+  PitchAnalyzer m_analyzer;
+
+  std::vector<float> m_buffer; // the samples not yet consumed by a full frame.
+  size_t m_skip = 0;           // the samples still to drop before the next frame, when the hop exceeds the frame.
+  std::vector<TrellisFrame> m_trellis; // the frames still waiting for their lookahead, oldest first.
+};
+
+#endif // #ifndef _INCLUDE_PITCH_H_
@@ -16,22 +16,42 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <libgen.h>
 #include <sys/types.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 #include <interf_dec.h>
 #include <interf_enc.h>
 #include <dec_if.h>
+#ifdef HAVE_AMRWB_ENCODER
+#include <enc_if.h>
+#endif
 
 #include "bs.h"
 #include "amr.h"
+#include "parallel.h"
 #include "samplerate.h"
 #include "minimp3.h"
 
 
 #define AMRNB_MAX_FRAME_TYPE  (8)    // SID Packet
 #define AMRWB_MAX_FRAME_TYPE  (9)    // SID Packet
+#define AMRWB_MAX_MODE        (8)    // 23.85k
+#define AMR_NO_DATA           (15)   // NO_DATA (DTX), the TOC only
+#define AMR_RTP_CMR_NONE      (15)   // no mode request
 #define AMRNB_NUM_SAMPLES   (160)
 #define AMRWB_NUM_SAMPLES   (320)
 #define AMRNB_OUT_MAX_SIZE  (32)
@@ -45,28 +65,270 @@ static const int b_octet_align = 1;
 
 
 #define tocGetF(toc) ((toc) >> 7)
-#define tocGetIndex(toc)  ((toc>>3) & 0xf)
-static int tocListCheck(uint8_t *tl, size_t buflen) { size_t s = 1; while (tocGetF(*tl)) { tl++; s++; if (s > buflen) return -1; } return s; }
-static int getFrameType(char* data) { return ((*(int*) data) & 0x78) >> 3; }
+#define tocGetIndex(toc)  (((toc)>>3) & 0xf)
+static int getFrameType(char* data) { return tocGetIndex((uint8_t)data[0]); }
 static int getFrameBytes(int frameType, enum AMR_TYPE type) { return (type==AMR_NB) ? amrnb_frame_sizes[frameType] + 1 : amrwb_frame_sizes[frameType] + 1; } // type == 0: AMR-NB,  type == 1: AMR-WB
 static int getFrameBytesDirect(char* data, enum AMR_TYPE type) { int frameType = getFrameType(data); return getFrameBytes(frameType, type); }
-static int getFrameCount(char* data, int size, enum AMR_TYPE type) {
+// A lone trailing 0x0a is never a complete frame, whereas a lone NO_DATA frame (DTX) is one byte long.
+static bool isTrailingNewline(char* data, int i, int size) { return i == size - 1 && data[i] == '\n'; }
+// 'frameTypes' (optional, 16 entries) receives the number of frames of each type.
+static int getFrameCount(char* data, int size, enum AMR_TYPE type, int* frameTypes = NULL) {
   int count = 0;
   int i = (type==AMR_NB) ? strlen(AMRNB_HEADER): strlen(AMRWB_HEADER);
   while(i < size) {
+    if(isTrailingNewline(data, i, size)) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+    if(frameTypes != NULL) frameTypes[getFrameType(data + i)] ++;
     i += getFrameBytesDirect(data + i, type);
-    if(i != size - 1) count ++; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
-
+    count ++;
   }
   return count;
 }
 
 
+// The pooled contexts are reset in place, through the functions and the contexts below, which the interface headers
+// of opencore-amr do not expose. They are pinned to opencore-amr 0.1.5, the version of lib/libopencore-amr*.a:
+// check them against its interf_enc.cpp and dec_if.cpp when the libraries are updated.
+extern "C" {
+  short Speech_Decode_Frame_reset(void* state);
+  short AMREncodeReset(void* encoderState, void* sidSyncState);
+  void pvDecoder_AmrWb_Reset(void* state, short resetAll);
+}
+
+// The context behind Encoder_Interface_init() (see interf_enc.cpp).
+struct AmrnbEncoderContext
+{
+  void* encCtx;
+  void* sidSyncCtx;
+};
+
+// The context behind D_IF_init() (see dec_if.cpp).
+struct AmrwbDecoderContext
+{
+  void* st;
+  void* pt_st;
+  short* scratchMem;
+  uint8_t* inputBuf;
+  short* inputSampleBuf;
+  short* outputBuf;
+  uint8_t quality;
+  short mode;
+  short modeOld;
+  short frameType;
+  short resetFlag;
+  short resetFlagOld;
+  short status;
+  short prevFrameType; // RX_State
+  short prevMode;
+};
+
+// The layouts of 0.1.5: its init functions allocate 16 and 72 bytes on LP64.
+static_assert(offsetof(AmrwbDecoderContext, prevMode) == 6 * sizeof(void*) + 16, "AmrwbDecoderContext does not match opencore-amr 0.1.5");
+#if defined(__LP64__)
+static_assert(sizeof(AmrnbEncoderContext) == 16, "AmrnbEncoderContext does not match opencore-amr 0.1.5");
+static_assert(sizeof(AmrwbDecoderContext) == 72, "AmrwbDecoderContext does not match opencore-amr 0.1.5");
+#endif
+
+// A library other than 0.1.5 may not match the contexts above: check a new one looks as D_IF_init() and
+// Encoder_Interface_init() of 0.1.5 leave it, once. Otherwise the contexts are created again instead of reset.
+static bool isAMRResetSafe()
+{
+  static const bool isSafe = []() {
+    AmrwbDecoderContext* decoder = (AmrwbDecoderContext*) D_IF_init();
+    AmrnbEncoderContext* encoder = (AmrnbEncoderContext*) Encoder_Interface_init(0);
+    bool isDecoderSafe = decoder != NULL && decoder->st != NULL && decoder->pt_st == decoder->st && decoder->scratchMem != NULL &&
+                         decoder->modeOld == 0 && decoder->resetFlag == 0 && decoder->resetFlagOld == 1 &&
+                         decoder->prevFrameType == 0 && decoder->prevMode == 0;
+    bool isEncoderSafe = encoder != NULL && encoder->encCtx != NULL && encoder->sidSyncCtx != NULL;
+    if (decoder != NULL) D_IF_exit(decoder);
+    if (encoder != NULL) Encoder_Interface_exit(encoder);
+    return isDecoderSafe && isEncoderSafe;
+  }();
+  return isSafe;
+}
+
+enum AMR_CODEC
+{
+  AMR_CODEC_NB_DECODER,
+  AMR_CODEC_WB_DECODER,
+  AMR_CODEC_NB_ENCODER,
+  AMR_CODEC_NB_DTX_ENCODER, // the DTX is set at the init of the AMR-NB encoder.
+  AMR_CODEC_WB_ENCODER,
+  AMR_NB_CODECS
+};
+
+static std::mutex amrPoolMutex;
+static std::vector<void*> amrPool[AMR_NB_CODECS];
+static size_t amrPoolSize = AMR_POOL_SIZE;
+
+static void* createAMRContext(enum AMR_CODEC codec)
+{
+  switch(codec) {
+    case AMR_CODEC_NB_DECODER: return Decoder_Interface_init();
+    case AMR_CODEC_WB_DECODER: return D_IF_init();
+#ifdef HAVE_AMRWB_ENCODER
+    case AMR_CODEC_WB_ENCODER: return E_IF_init();
+#else
+    case AMR_CODEC_WB_ENCODER: return NULL; // not built in.
+#endif
+    case AMR_CODEC_NB_DTX_ENCODER: return Encoder_Interface_init(1);
+    default: return Encoder_Interface_init(0);
+  }
+}
+
+static void destroyAMRContext(void* context, enum AMR_CODEC codec)
+{
+  switch(codec) {
+    case AMR_CODEC_NB_DECODER: Decoder_Interface_exit(context); break;
+    case AMR_CODEC_WB_DECODER: D_IF_exit(context); break;
+#ifdef HAVE_AMRWB_ENCODER
+    case AMR_CODEC_WB_ENCODER: E_IF_exit(context); break;
+#endif
+    default: Encoder_Interface_exit(context); break;
+  }
+}
+
+// vo-amrwbenc has no reset, and its state is not known: the AMR-WB encoders are created for each use, not pooled.
+static bool isAMRPooled(enum AMR_CODEC codec)
+{
+  return codec != AMR_CODEC_WB_ENCODER;
+}
+
+// Bring the pooled context back to the state right after its init. Returns the context to keep.
+static void* resetAMRContext(void* context, enum AMR_CODEC codec)
+{
+  if (!isAMRResetSafe()) {
+    destroyAMRContext(context, codec);
+    return createAMRContext(codec);
+  }
+  switch(codec) {
+    case AMR_CODEC_NB_DECODER:
+      Speech_Decode_Frame_reset(context);
+      break;
+    case AMR_CODEC_WB_DECODER: {
+      AmrwbDecoderContext* state = (AmrwbDecoderContext*) context;
+      pvDecoder_AmrWb_Reset(state->st, 1);
+      state->modeOld = 0;
+      state->resetFlag = 0;
+      state->resetFlagOld = 1;
+      state->prevFrameType = 0;
+      state->prevMode = 0;
+      break;
+    }
+    default: {
+      // The DTX flag is kept by the reset.
+      AmrnbEncoderContext* state = (AmrnbEncoderContext*) context;
+      AMREncodeReset(state->encCtx, state->sidSyncCtx);
+      break;
+    }
+  }
+  return context;
+}
+
+static void* acquireAMRContext(enum AMR_CODEC codec)
+{
+  if (isAMRPooled(codec)) {
+    std::lock_guard<std::mutex> lock(amrPoolMutex);
+    if (!amrPool[codec].empty()) {
+      void* context = amrPool[codec].back();
+      amrPool[codec].pop_back();
+      return context;
+    }
+  }
+  return createAMRContext(codec);
+}
+
+static void releaseAMRContext(void* context, enum AMR_CODEC codec)
+{
+  if (context == NULL) return;
+  if (!isAMRPooled(codec)) {
+    destroyAMRContext(context, codec);
+    return;
+  }
+
+  // Reset it outside of the lock.
+  context = resetAMRContext(context, codec);
+  if (context == NULL) return;
+  {
+    std::lock_guard<std::mutex> lock(amrPoolMutex);
+    if (amrPool[codec].size() < amrPoolSize) {
+      amrPool[codec].push_back(context);
+      return;
+    }
+  }
+  destroyAMRContext(context, codec);
+}
+
+void* acquireAMRDecoder(enum AMR_TYPE type)
+{
+  return acquireAMRContext((type==AMR_NB) ? AMR_CODEC_NB_DECODER : AMR_CODEC_WB_DECODER);
+}
+
+void releaseAMRDecoder(void* decoder, enum AMR_TYPE type)
+{
+  releaseAMRContext(decoder, (type==AMR_NB) ? AMR_CODEC_NB_DECODER : AMR_CODEC_WB_DECODER);
+}
+
+static enum AMR_CODEC getAMREncoderCodec(enum AMR_TYPE type, bool dtx)
+{
+  if (type != AMR_NB) return AMR_CODEC_WB_ENCODER; // the AMR-WB encoder takes the DTX per frame.
+  return dtx ? AMR_CODEC_NB_DTX_ENCODER : AMR_CODEC_NB_ENCODER;
+}
+
+void* acquireAMREncoder(enum AMR_TYPE type, bool dtx)
+{
+  return acquireAMRContext(getAMREncoderCodec(type, dtx));
+}
+
+void releaseAMREncoder(void* encoder, enum AMR_TYPE type, bool dtx)
+{
+  releaseAMRContext(encoder, getAMREncoderCodec(type, dtx));
+}
+
+void setAMRPoolSize(int size)
+{
+  std::vector<void*> extra[AMR_NB_CODECS];
+  {
+    std::lock_guard<std::mutex> lock(amrPoolMutex);
+    amrPoolSize = (size > 0) ? size : 0;
+    for (int codec=0; codec<AMR_NB_CODECS; codec++) {
+      while (amrPool[codec].size() > amrPoolSize) {
+        extra[codec].push_back(amrPool[codec].back());
+        amrPool[codec].pop_back();
+      }
+    }
+  }
+  for (int codec=0; codec<AMR_NB_CODECS; codec++) {
+    for (size_t i=0; i<extra[codec].size(); i++) destroyAMRContext(extra[codec][i], (enum AMR_CODEC)codec);
+  }
+}
+
+void warmUpAMRPool(int count)
+{
+  for (int codec=0; codec<AMR_NB_CODECS; codec++) {
+    if (!isAMRPooled((enum AMR_CODEC)codec)) continue;
+    std::vector<void*> contexts;
+    for (int i=0; i<count; i++) contexts.push_back(createAMRContext((enum AMR_CODEC)codec));
+    for (size_t i=0; i<contexts.size(); i++) releaseAMRContext(contexts[i], (enum AMR_CODEC)codec);
+  }
+}
+
+static std::atomic<long> amrErrorCounts[AMR_NB_ERRORS];
+
+static void countAMRError(enum AMR_ERROR error)
+{
+  amrErrorCounts[error]++;
+}
+
+long getAMRErrorCount(enum AMR_ERROR error)
+{
+  return amrErrorCounts[error];
+}
+
 enum AMR_TYPE getAMRType(char* data, int size)
 {
-  return (0==strncmp(data, AMRNB_HEADER, strlen(AMRNB_HEADER)))
+  return (size >= (int)strlen(AMRNB_HEADER) && 0==strncmp(data, AMRNB_HEADER, strlen(AMRNB_HEADER)))
          ? AMR_NB
-         : ( (0==strncmp(data, AMRWB_HEADER, strlen(AMRWB_HEADER)))
+         : ( (size >= (int)strlen(AMRWB_HEADER) && 0==strncmp(data, AMRWB_HEADER, strlen(AMRWB_HEADER)))
            ? AMR_WB
            : AMR_UNKNOWN);
 }
@@ -77,50 +339,104 @@ int getSampleCount(char* data, int size, enum AMR_TYPE type)
   return (type==AMR_NB) ? nbFrames * AMRNB_NUM_SAMPLES : nbFrames * AMRWB_NUM_SAMPLES;
 }
 
-static int amrDecodeFrame(char *data, int nSize, short* pcmDataCurrentFrame, void* amrDecoder, enum AMR_TYPE type)
+int probeAMR(char* data, int size, AmrProbe &probe)
 {
-  if(nSize < 2) { printf("Too short packet\n"); return -1; } // it means that the framesize is 0, needs to abort.
+  memset(&probe, 0, sizeof(probe));
+  probe.type = getAMRType(data, size);
+  if ( probe.type == AMR_UNKNOWN ) return -1;
+
+  probe.sampleRate = (probe.type==AMR_NB) ? 8000 : 16000;
+  probe.nbFrames = getFrameCount(data, size, probe.type, probe.frameTypes);
+  probe.durationMs = (double) probe.nbFrames * AMR_FRAME_MS;
+
+  return 0;
+}
 
-  hbs_t* payload = bs_new((uint8_t *)data, nSize);
-  if(payload == NULL) { return -2; }
+// Check the octet-aligned TOC list of a packet and its frame data, which takes the rest of the packet.
+// Returns the number of TOC entries, or negative (-AMR_ERROR_*) if the packet is invalid.
+static int parseTocList(const uint8_t* packet, int nSize, enum AMR_TYPE type)
+{
+  if(nSize < 1) { countAMRError(AMR_ERROR_SHORT_FRAME); return -AMR_ERROR_SHORT_FRAME; } // it means that the framesize is 0, needs to abort.
 
+  const int* frameSizes = (type==AMR_NB) ? amrnb_frame_sizes : amrwb_frame_sizes;
   int amrMaxFrameType = (type==AMR_NB) ? AMRNB_MAX_FRAME_TYPE : AMRWB_MAX_FRAME_TYPE;
 
-  uint8_t tocs[20] = {0,};
-  int nTocLen = 0, nFrameData = 0, nFbit = 1, nFTbits = 0, nQbit = 0;
-  while(nFbit == 1)
+  // 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7
+  // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  // |1|  FT   |Q|1|  FT   |Q|0|  FT   |Q|
+  // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  // Each TOC entry takes one byte (two padding bits), so it is read directly.
+  int nTocLen = 0, nFrameData = 0;
+  do
   {
-    // 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7
-    // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    // |1|  FT   |Q|1|  FT   |Q|0|  FT   |Q|
-    // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-    nFbit = bs_read_u(payload, 1);
-    nFTbits = bs_read_u(payload, 4);
-    if(nFTbits > amrMaxFrameType) { printf("%s, Bad amr toc, index=%i (MAX=%d)\n", __func__, nFTbits, amrMaxFrameType); break; }
-    nFrameData += (getFrameBytes(nFTbits, type) - 1);
-    nQbit = bs_read_u(payload, 1);
-    tocs[nTocLen++] = ((nFbit << 7) | (nFTbits << 3) | (nQbit << 2)) & 0xFC;
-    if(b_octet_align == 1) { bs_read_u(payload, 2); } // two padding bits.
-  }
-
-  if ( -1 == tocListCheck(tocs, nSize) ) { printf("Bad AMR toc list\n"); bs_free(payload); return -3; }
-  if((nFrameData) != bs_bytes_left(payload)) { printf("%s, invalid data mismatch, FrameData=%d, bytes_left=%d\n", __func__, nFrameData, bs_bytes_left(payload)); }
-
-  uint8_t tmp[AMR_OUT_MAX_SIZE];
+    if(nTocLen >= nSize) { countAMRError(AMR_ERROR_BAD_TOC); return -AMR_ERROR_BAD_TOC; }
+    int index = tocGetIndex(packet[nTocLen]);
+    if(index > amrMaxFrameType && index != AMR_NO_DATA) { countAMRError(AMR_ERROR_BAD_FRAME_TYPE); return -AMR_ERROR_BAD_FRAME_TYPE; }
+    nFrameData += frameSizes[index]; // a NO_DATA frame (DTX) has the TOC only, the codec fills it with the comfort noise.
+  } while(tocGetF(packet[nTocLen++]));
+
+  if(nTocLen + nFrameData != nSize) { countAMRError(AMR_ERROR_SIZE_MISMATCH); return -AMR_ERROR_SIZE_MISMATCH; }
+
+  return nTocLen;
+}
+
+// Decode the frames of one octet-aligned packet, i.e., the TOC list followed by the frame data.
+// 'pcm' receives AMRNB_NUM_SAMPLES (or AMRWB_NUM_SAMPLES) samples per TOC entry.
+// Returns the number of decoded frames, or negative (-AMR_ERROR_*) if the packet is invalid.
+static int amrDecodeFrame(const char *data, int nSize, short* pcm, void* amrDecoder, enum AMR_TYPE type)
+{
+  const uint8_t* packet = (const uint8_t*) data;
+  const int* frameSizes = (type==AMR_NB) ? amrnb_frame_sizes : amrwb_frame_sizes;
+
+  int nTocLen = parseTocList(packet, nSize, type);
+  if(nTocLen < 0) return nTocLen;
+
+  int frameSamples = (type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES;
+  if(nTocLen == 1)
+  {
+    // The storage format: the TOC is right before its frame data, so the codec reads them in place.
+    (type==AMR_NB) ? Decoder_Interface_Decode(amrDecoder, packet, pcm, 0) : D_IF_decode(amrDecoder, packet, pcm, 0);
+    return 1;
+  }
+
+  // The codec wants each TOC right before its frame data.
+  uint8_t frame[AMR_MAX_FRAME_BYTES];
+  const uint8_t* payload = packet + nTocLen;
   for(int i=0; i<nTocLen; i++)
   {
-    memset(tmp, 0, sizeof(tmp));
-    tmp[0] = tocs[i];
-    int index = tocGetIndex(tocs[i]);
-    if (index > amrMaxFrameType) { printf("Bad amr toc, index=%i\n", index); break; }
-    bs_read_bytes_ex(payload, &tmp[1], (getFrameBytes(index, type) - 1));
+    int size = frameSizes[tocGetIndex(packet[i])];
+    frame[0] = packet[i] & 0x7C; // clear the F bit and the padding bits.
+    memcpy(&frame[1], payload, size);
+    payload += size;
 
-    (type==AMR_NB) ? Decoder_Interface_Decode(amrDecoder, tmp, pcmDataCurrentFrame, 0) : D_IF_decode(amrDecoder, tmp, pcmDataCurrentFrame, 0);
+    (type==AMR_NB) ? Decoder_Interface_Decode(amrDecoder, frame, pcm, 0) : D_IF_decode(amrDecoder, frame, pcm, 0);
+    pcm += frameSamples;
+  }
+
+  return nTocLen;
+}
+
+// Decode all the frames into 'pcm', which holds getSampleCount() samples (zeroed).
+static void amrDecodeAll(char* data, int size, enum AMR_TYPE type, short* pcm)
+{
+  short* pcmDataCurrentFrame = pcm;
+
+  void* amrDecoder = acquireAMRDecoder(type);
 
+  int i = (type==AMR_NB) ? strlen(AMRNB_HEADER) : strlen(AMRWB_HEADER);
+  while(i < size)
+  {
+    int frameBytes = getFrameBytesDirect(data + i, type);
+    if ( i + frameBytes > size ) break; // the last frame is truncated.
+    int rc = amrDecodeFrame(data + i, frameBytes, pcmDataCurrentFrame, amrDecoder, type);
+    if ( rc < 0 ) break; // there is something wrong with the data, needs to abort.
+    i += frameBytes;
+    if (isTrailingNewline(data, i, size)) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+    pcmDataCurrentFrame += ( (type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES );
   }
-  bs_free(payload);
 
-  return 0;
+  releaseAMRDecoder(amrDecoder, type);
+  amrDecoder = NULL;
 }
 
 short* amr2pcm(char* data, int size)
@@ -131,82 +447,568 @@ short* amr2pcm(char* data, int size)
   int samples = getSampleCount(data, size, type);
   short* pcmData = (short*) malloc( samples * sizeof(short) );
   memset(pcmData, 0, samples * sizeof(short));
-  short* pcmDataCurrentFrame = pcmData;
 
-  void* amrDecoder = (type==AMR_NB) ? Decoder_Interface_init() : D_IF_init();
+  amrDecodeAll(data, size, type, pcmData);
 
-  int i = (type==AMR_NB) ? strlen(AMRNB_HEADER) : strlen(AMRWB_HEADER);
+  return pcmData;
+}
+
+short* amr2pcmBatch(char** data, int* sizes, int count, size_t* offsets, int* sampleRates, int nbThreads)
+{
+  std::vector<enum AMR_TYPE> types(count);
+  std::vector<int> samples(count);
+
+  // Count the samples of each buffer, then lay them out back to back.
+  parallelFor(count, nbThreads, [&](size_t i) {
+    types[i] = getAMRType(data[i], sizes[i]);
+    samples[i] = (types[i]==AMR_UNKNOWN) ? 0 : getSampleCount(data[i], sizes[i], types[i]);
+  });
+
+  offsets[0] = 0;
+  for (int i=0; i<count; i++)
+  {
+    offsets[i+1] = offsets[i] + samples[i];
+    sampleRates[i] = (types[i]==AMR_NB) ? 8000 : ( (types[i]==AMR_WB) ? 16000 : 0 );
+  }
+
+  short* pcmData = (short*) malloc( (offsets[count] > 0 ? offsets[count] : 1) * sizeof(short) );
+  if (pcmData == NULL) return NULL;
+
+  // Each worker decodes whole buffers with a pooled decoder, straight into its slice.
+  parallelFor(count, nbThreads, [&](size_t i) {
+    memset(pcmData + offsets[i], 0, samples[i] * sizeof(short));
+    if (types[i] != AMR_UNKNOWN) amrDecodeAll(data[i], sizes[i], types[i], pcmData + offsets[i]);
+  });
+
+  return pcmData;
+}
+
+int buildAMRIndex(char* data, int size, int step, AmrIndex &index)
+{
+  index.type = getAMRType(data, size);
+  if ( index.type == AMR_UNKNOWN || step <= 0 ) return -1;
+
+  index.size = size;
+  index.step = step;
+  index.nbFrames = 0;
+  index.offsets.clear();
+
+  // The same walk as the decoding, so that the frame numbers match the amr2pcm output.
+  int i = (index.type==AMR_NB) ? strlen(AMRNB_HEADER) : strlen(AMRWB_HEADER);
   while(i < size)
   {
-    int frameBytes = getFrameBytesDirect(data + i, type);
-    int rc = amrDecodeFrame(data + i, frameBytes, pcmDataCurrentFrame, amrDecoder, type);
+    int frameBytes = getFrameBytesDirect(data + i, index.type);
+    if ( i + frameBytes > size ) break; // the last frame is truncated.
+    if ( index.nbFrames % step == 0 ) index.offsets.push_back(i);
+    index.nbFrames ++;
+    i += frameBytes;
+    if (isTrailingNewline(data, i, size)) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+  }
+
+  return 0;
+}
+
+short* amrDecodeRange(char* data, int size, const AmrIndex &index, double startMs, double endMs, int preRoll, int* nbSamples)
+{
+  *nbSamples = 0;
+  if ( index.type == AMR_UNKNOWN || index.size != size || index.step <= 0 ) return NULL;
+  if ( index.nbFrames > 0 && (int)index.offsets.size() != (index.nbFrames - 1) / index.step + 1 ) return NULL;
+
+  int sampleRate = (index.type==AMR_NB) ? 8000 : 16000;
+  int frameSamples = (index.type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES;
+  long totalSamples = (long) index.nbFrames * frameSamples;
+  long startSample = (startMs > 0) ? (long)(startMs * sampleRate / 1000) : 0;
+  long endSample = (long)(endMs * sampleRate / 1000);
+  if ( endSample > totalSamples ) endSample = totalSamples;
+  if ( startSample >= endSample ) return NULL;
+
+  // The frames covering the range, and the first one to decode.
+  int first = startSample / frameSamples;
+  int last = (endSample + frameSamples - 1) / frameSamples;
+  int frame = (first > preRoll) ? first - preRoll : 0;
+
+  // Jump to the closest indexed frame, then walk the headers up to the first frame to decode.
+  int i = index.offsets[frame / index.step];
+  for (int k = frame - frame % index.step; k < frame && i < size; k++) i += getFrameBytesDirect(data + i, index.type);
+
+  short* pcmData = (short*) malloc( (last - first) * frameSamples * sizeof(short) );
+  memset(pcmData, 0, (last - first) * frameSamples * sizeof(short));
+  short preRollFrame[AMRWB_NUM_SAMPLES];
+
+  void* amrDecoder = acquireAMRDecoder(index.type);
+  for (; frame < last; frame++)
+  {
+    if ( i >= size ) break;
+    int frameBytes = getFrameBytesDirect(data + i, index.type);
+    if ( i + frameBytes > size ) break; // the last frame is truncated.
+    short* pcm = (frame < first) ? preRollFrame : pcmData + (frame - first) * frameSamples;
+    int rc = amrDecodeFrame(data + i, frameBytes, pcm, amrDecoder, index.type);
     if ( rc < 0 ) break; // there is something wrong with the data, needs to abort.
     i += frameBytes;
-    if (i == size - 1) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
-    pcmDataCurrentFrame += ( (type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES );
   }
+  releaseAMRDecoder(amrDecoder, index.type);
 
-  (type==AMR_NB) ? Decoder_Interface_exit(amrDecoder) : D_IF_exit(amrDecoder);
-  amrDecoder = NULL;
+  // Drop the samples of the first frame before the start.
+  *nbSamples = endSample - startSample;
+  int head = startSample - (long) first * frameSamples;
+  if ( head > 0 ) memmove(pcmData, pcmData + head, *nbSamples * sizeof(short));
 
   return pcmData;
 }
 
-int amr_remove_silence(char* data, int size, float threshold, char** pOutput, int* szOutput) {
-  enum AMR_TYPE type = getAMRType(data, size);
-  if ( type == AMR_UNKNOWN ) return -1;
+static void writeUint32(char* data, uint32_t value)
+{
+  for (int i=0; i<4; i++) data[i] = (value >> (8*i)) & 0xff;
+}
+
+static uint32_t readUint32(const char* data)
+{
+  uint32_t value = 0;
+  for (int i=0; i<4; i++) value |= ((uint32_t)(uint8_t)data[i]) << (8*i);
+  return value;
+}
+
+// "AMRI", version, type, step, nbFrames, size, then the offsets. All are 32-bit.
+#define AMR_INDEX_MAGIC       "AMRI"
+#define AMR_INDEX_VERSION     (1)
+#define AMR_INDEX_HEADER_SIZE (24)
+
+char* serializeAMRIndex(const AmrIndex &index, int* out_size)
+{
+  *out_size = AMR_INDEX_HEADER_SIZE + 4 * index.offsets.size();
+  char* result = (char*) malloc(*out_size);
+
+  memcpy(result, AMR_INDEX_MAGIC, 4);
+  writeUint32(result + 4, AMR_INDEX_VERSION);
+  writeUint32(result + 8, index.type);
+  writeUint32(result + 12, index.step);
+  writeUint32(result + 16, index.nbFrames);
+  writeUint32(result + 20, index.size);
+  for (size_t i=0; i<index.offsets.size(); i++) writeUint32(result + AMR_INDEX_HEADER_SIZE + 4*i, index.offsets[i]);
+
+  return result;
+}
+
+int deserializeAMRIndex(const char* data, int size, AmrIndex &index)
+{
+  if ( size < AMR_INDEX_HEADER_SIZE || 0 != memcmp(data, AMR_INDEX_MAGIC, 4) ) return -1;
+  if ( readUint32(data + 4) != AMR_INDEX_VERSION ) return -1;
+
+  index.type = (enum AMR_TYPE) readUint32(data + 8);
+  index.step = readUint32(data + 12);
+  index.nbFrames = readUint32(data + 16);
+  index.size = readUint32(data + 20);
+  if ( index.type != AMR_NB && index.type != AMR_WB ) return -1;
+  if ( index.step <= 0 || index.nbFrames < 0 || index.size < 0 ) return -1;
+
+  int nbOffsets = (index.nbFrames > 0) ? (index.nbFrames - 1) / index.step + 1 : 0;
+  if ( size != AMR_INDEX_HEADER_SIZE + 4 * nbOffsets ) return -1;
+  index.offsets.resize(nbOffsets);
+  for (int i=0; i<nbOffsets; i++)
+  {
+    index.offsets[i] = readUint32(data + AMR_INDEX_HEADER_SIZE + 4*i);
+    if ( index.offsets[i] < 0 || index.offsets[i] >= index.size ) return -1;
+  }
+
+  return 0;
+}
+
+AmrDecoder::AmrDecoder()
+  : m_type(AMR_UNKNOWN), m_decoder(NULL), m_nbPending(0), m_isInvalid(false)
+{
+}
 
+AmrDecoder::~AmrDecoder()
+{
+  reset();
+}
+
+void AmrDecoder::reset()
+{
+  if (m_decoder != NULL) releaseAMRDecoder(m_decoder, m_type);
+  m_decoder = NULL;
+  m_type = AMR_UNKNOWN;
+  m_nbPending = 0;
+  m_isInvalid = false;
+}
+
+// Collect the header byte by byte, since "#!AMR" starts both the AMR-NB and the AMR-WB headers.
+int AmrDecoder::parseHeader(const char* data, size_t length, size_t* consumed)
+{
+  int szNBHeader = strlen(AMRNB_HEADER);
+  int szWBHeader = strlen(AMRWB_HEADER);
+
+  size_t i = 0;
+  while (i < length && m_type == AMR_UNKNOWN)
+  {
+    if (m_nbPending >= (int)sizeof(m_pending)) return -1;
+    m_pending[m_nbPending++] = data[i++];
+
+    bool isNB = (0==strncmp(m_pending, AMRNB_HEADER, (m_nbPending < szNBHeader) ? m_nbPending : szNBHeader));
+    bool isWB = (0==strncmp(m_pending, AMRWB_HEADER, (m_nbPending < szWBHeader) ? m_nbPending : szWBHeader));
+    if (!isNB && !isWB) return -1; // not an AMR stream.
+
+    if (isNB && m_nbPending == szNBHeader) m_type = AMR_NB;
+    if (isWB && m_nbPending == szWBHeader) m_type = AMR_WB;
+  }
+  *consumed = i;
+
+  if (m_type != AMR_UNKNOWN)
+  {
+    m_decoder = acquireAMRDecoder(m_type);
+    m_nbPending = 0;
+  }
+
+  return 0;
+}
+
+int AmrDecoder::decodeFrame(const char* frame, int frameBytes, std::vector<short> &pcm)
+{
+  int frameSamples = (m_type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES;
+  size_t offset = pcm.size();
+  pcm.resize(offset + frameSamples, 0);
+
+  int rc = amrDecodeFrame(frame, frameBytes, &pcm[offset], m_decoder, m_type);
+  if (rc < 0) pcm.resize(offset);
+
+  return rc;
+}
+
+int AmrDecoder::process(const char* data, size_t length, std::vector<short> &pcm)
+{
+  if (m_isInvalid) return -1;
+
+  size_t i = 0;
+  if (m_type == AMR_UNKNOWN)
+  {
+    if (parseHeader(data, length, &i) < 0) { m_isInvalid = true; return -1; }
+    if (m_type == AMR_UNKNOWN) return 0; // the header is still incomplete.
+  }
+
+  while (i < length)
+  {
+    // Complete the frame split over the previous chunk.
+    if (m_nbPending > 0)
+    {
+      int frameBytes = getFrameBytes(tocGetIndex((uint8_t)m_pending[0]), m_type);
+      size_t n = frameBytes - m_nbPending;
+      if (n > length - i) n = length - i;
+      memcpy(m_pending + m_nbPending, data + i, n);
+      m_nbPending += n;
+      i += n;
+      if (m_nbPending < frameBytes) break;
+
+      m_nbPending = 0;
+      int rc = decodeFrame(m_pending, frameBytes, pcm);
+      if (rc < 0) { m_isInvalid = true; return rc; }
+      continue;
+    }
+
+    // Decode the frames straight from the chunk.
+    int frameBytes = getFrameBytes(tocGetIndex((uint8_t)data[i]), m_type);
+    if (frameBytes > (int)(length - i))
+    {
+      // Keep the incomplete frame for the next chunk.
+      m_nbPending = length - i;
+      memcpy(m_pending, data + i, m_nbPending);
+      break;
+    }
+
+    int rc = decodeFrame(data + i, frameBytes, pcm);
+    if (rc < 0) { m_isInvalid = true; return rc; }
+    i += frameBytes;
+  }
+
+  return 0;
+}
+
+// The sum of the squares of the samples, exact in 64 bits.
+static long long getFrameEnergy(const short* pcm, int n)
+{
+  long long sum = 0;
+  int i = 0;
+#if defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+    __m128i sq = _mm_madd_epi16(x, x); // a*a + b*b <= 2^31, so it is read as unsigned.
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+  }
+  long long lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, acc);
+  sum = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+  int64x2_t acc = vdupq_n_s64(0);
+  for (; i + 4 <= n; i += 4) {
+    int16x4_t x = vld1_s16(pcm + i);
+    acc = vpadalq_s32(acc, vmull_s16(x, x));
+  }
+  sum = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+#endif
+  for (; i < n; i++) sum += (int)pcm[i] * (int)pcm[i];
+  return sum;
+}
+
+// NO_DATA and SID frames (and the ones without speech data) are silent, no need to decode them.
+static bool isSilentFrame(char* data, enum AMR_TYPE type)
+{
+  int frameType = getFrameType(data);
+  int sidType = (type==AMR_NB) ? AMRNB_MAX_FRAME_TYPE : AMRWB_MAX_FRAME_TYPE;
+  return frameType >= sidType;
+}
+
+// Find the loud frames within [from, to), decoding from 'preRoll' frames earlier.
+// Returns the first (or the last if 'isLast') loud frame, or -1 if all the frames are silent.
+static int findLoudFrame(char* data, const std::vector<int> &offsets, int from, int to, int preRoll, bool isLast, long long limit, enum AMR_TYPE type)
+{
+  short pcm[AMRWB_NUM_SAMPLES];
   int frameSamples = (type==AMR_NB) ? AMRNB_NUM_SAMPLES : AMRWB_NUM_SAMPLES;
-  short* pcmFrameData = (short*) malloc( frameSamples * sizeof(short) );
-  memset(pcmFrameData, 0, frameSamples * sizeof(short));
+  int loud = -1;
+
+  void* amrDecoder = acquireAMRDecoder(type);
+  for (int k = (from > preRoll) ? from - preRoll : 0; k < to; k++)
+  {
+    char* frame = data + offsets[k];
+    if ( isSilentFrame(frame, type) ) continue;
+    if ( amrDecodeFrame(frame, offsets[k+1] - offsets[k], pcm, amrDecoder, type) < 0 ) continue;
+    if ( k < from || getFrameEnergy(pcm, frameSamples) < limit ) continue;
+
+    loud = k;
+    if ( !isLast ) break;
+  }
+  releaseAMRDecoder(amrDecoder, type);
+
+  return loud;
+}
 
-  void* amrDecoder = (type==AMR_NB) ? Decoder_Interface_init() : D_IF_init();
+int amr_remove_silence(char* data, int size, float threshold, char** pOutput, int* szOutput) {
+  enum AMR_TYPE type = getAMRType(data, size);
+  if ( type == AMR_UNKNOWN ) return -1;
 
-  // Find the first (start) and the last (end) frame.
+  // Walk the frame headers only: offsets[k] is the start of the frame k, and the last one is the end.
   int szHeader = (type==AMR_NB) ? strlen(AMRNB_HEADER) : strlen(AMRWB_HEADER);
-  int start = 0;
-  int end = 0;
+  std::vector<int> offsets;
   int i = szHeader;
   while(i < size)
   {
     int frameBytes = getFrameBytesDirect(data + i, type);
-    int rc = amrDecodeFrame(data + i, frameBytes, pcmFrameData, amrDecoder, type);
-    if ( rc < 0 ) break; // there is something wrong with the data, needs to abort.
-    float sum = 0.0;
-    for(int j=0; j<frameSamples; j++) {
-      float d = (int)pcmFrameData[j] / 32768.0;
-      sum += d * d;
-    }
-//    printf("%d: sum = %f\n", i, sum);
-    if (sum < threshold) {
-     if (end == 0) {
-       start = i;
-     }
-    } else {
-      end = i + frameBytes;
-    }
+    if ( i + frameBytes > size ) break; // the last frame is truncated.
+    offsets.push_back(i);
     i += frameBytes;
-    if (i == size - 1) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+    if (isTrailingNewline(data, i, size)) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+  }
+  offsets.push_back(i);
+  int nbFrames = offsets.size() - 1;
+
+  // The threshold is on the sum of the squares of the samples normalized to [-1, 1].
+  long long limit = (long long) ceil(threshold * 32768.0 * 32768.0);
+
+  // Scan inward from the beginning: the decoding runs from the first frame, as long as it is silent.
+  int first = findLoudFrame(data, offsets, 0, nbFrames, 0, false, limit, type);
+
+  // Scan inward from the end, one block at a time. Each block starts decoding a few frames earlier.
+  int last = first;
+  int blockEnd = nbFrames;
+  while ( first >= 0 && blockEnd > first + 1 )
+  {
+    while ( blockEnd > first + 1 && isSilentFrame(data + offsets[blockEnd - 1], type) ) blockEnd --;
+    if ( blockEnd <= first + 1 ) break;
+
+    int blockStart = (blockEnd - AMR_TRIM_BLOCK > first + 1) ? blockEnd - AMR_TRIM_BLOCK : first + 1;
+    int loud = findLoudFrame(data, offsets, blockStart, blockEnd, AMR_PRE_ROLL, true, limit, type);
+    if ( loud >= 0 ) { last = loud; break; }
+    blockEnd = blockStart;
   }
+
+  // Keep one silent frame before the first loud frame. Nothing is kept if all the frames are silent.
+  int start = (first > 0) ? offsets[first - 1] : szHeader;
+  int end = (first >= 0) ? offsets[last + 1] : start;
+
   int szAMRData = end - start;
   *szOutput = szHeader + szAMRData;
   *pOutput = (char*) malloc(*szOutput);
   memcpy(*pOutput, data, szHeader);
   memcpy(*pOutput + szHeader, data + start, szAMRData);
-//  printf("start = %d, end = %d\n", start, end);
 
-  (type==AMR_NB) ? Decoder_Interface_exit(amrDecoder) : D_IF_exit(amrDecoder);
-  amrDecoder = NULL;
+  return 0;
+}
+
+int selectAMRFrames(char* data, int size, double startMs, double endMs, AmrFrames &frames)
+{
+  frames.type = getAMRType(data, size);
+  if ( frames.type == AMR_UNKNOWN ) return -1;
+
+  double first = (startMs > 0) ? floor(startMs / AMR_FRAME_MS + 0.5) : 0;
+  double last = floor(endMs / AMR_FRAME_MS + 0.5);
+
+  // Walk the frame headers up to the last selected frame.
+  int szHeader = (frames.type==AMR_NB) ? strlen(AMRNB_HEADER) : strlen(AMRWB_HEADER);
+  frames.data = data;
+  frames.start = szHeader;
+  frames.end = szHeader;
+  int i = szHeader;
+  int k = 0;
+  while(i < size && k < last)
+  {
+    int frameBytes = getFrameBytesDirect(data + i, frames.type);
+    if ( i + frameBytes > size ) break; // the last frame is truncated.
+    i += frameBytes;
+    k ++;
+    if ( k == first ) frames.start = i;
+    if (isTrailingNewline(data, i, size)) break; // TO AVOID THE CASE THAT THE TRAILING CHARACTER IS 0x0a, i.e., \n
+  }
+  frames.end = i;
+  if ( k < first || first >= last ) frames.start = frames.end; // the range is empty.
 
   return 0;
 }
 
+int writeAMRFrames(const std::vector<AmrFrames> &frames, char* output)
+{
+  if ( frames.empty() ) return -1;
+  enum AMR_TYPE type = frames[0].type;
+  const char* header = (type==AMR_NB) ? AMRNB_HEADER : AMRWB_HEADER;
+
+  int size = strlen(header);
+  for (size_t i=0; i<frames.size(); i++)
+  {
+    if ( frames[i].type != type || frames[i].type == AMR_UNKNOWN ) return -1;
+    size += frames[i].end - frames[i].start;
+  }
+  if ( output == NULL ) return size;
+
+  memcpy(output, header, strlen(header));
+  char* p = output + strlen(header);
+  for (size_t i=0; i<frames.size(); i++)
+  {
+    memcpy(p, frames[i].data + frames[i].start, frames[i].end - frames[i].start);
+    p += frames[i].end - frames[i].start;
+  }
+
+  return size;
+}
+
+static char* writeAMRFramesAlloc(const std::vector<AmrFrames> &frames, int* out_size)
+{
+  *out_size = writeAMRFrames(frames, NULL);
+  if ( *out_size < 0 ) return NULL;
+
+  char* result = (char*) malloc(*out_size);
+  writeAMRFrames(frames, result);
+
+  return result;
+}
+
+char* amr_concat(char** data, int* sizes, int count, int* out_size)
+{
+  std::vector<AmrFrames> frames(count);
+  for (int i=0; i<count; i++)
+  {
+    if ( selectAMRFrames(data[i], sizes[i], 0, HUGE_VAL, frames[i]) < 0 ) return NULL;
+  }
+  return writeAMRFramesAlloc(frames, out_size);
+}
+
+char* amr_cut(char* data, int size, double startMs, double endMs, int* out_size)
+{
+  std::vector<AmrFrames> frames(1);
+  if ( selectAMRFrames(data, size, startMs, endMs, frames[0]) < 0 ) return NULL;
+  return writeAMRFramesAlloc(frames, out_size);
+}
+
+char* amr_splice(char* data, int size, double startMs, double endMs, char* insert, int szInsert, int* out_size)
+{
+  std::vector<AmrFrames> frames(3);
+  if ( selectAMRFrames(data, size, 0, startMs, frames[0]) < 0 ) return NULL;
+  if ( selectAMRFrames(insert, szInsert, 0, HUGE_VAL, frames[1]) < 0 ) return NULL;
+  if ( selectAMRFrames(data, size, (endMs > startMs) ? endMs : startMs, HUGE_VAL, frames[2]) < 0 ) return NULL;
+  return writeAMRFramesAlloc(frames, out_size);
+}
+
+int amrPacketize(char* data, int size, int* position, int framesPerPacket, char* payload, int capacity)
+{
+  enum AMR_TYPE type = getAMRType(data, size);
+  if ( type == AMR_UNKNOWN ) return -1;
+
+  int szHeader = strlen( (type==AMR_NB) ? AMRNB_HEADER : AMRWB_HEADER );
+  int i = (*position < szHeader) ? szHeader : *position;
+  int amrMaxFrameType = (type==AMR_NB) ? AMRNB_MAX_FRAME_TYPE : AMRWB_MAX_FRAME_TYPE;
+
+  // Count the frames of the packet first, as all the TOC entries come before the frame data.
+  int nbFrames = 0, nFrameData = 0;
+  int end = i;
+  bool isFull = false;
+  while ( nbFrames < framesPerPacket && end < size && !isTrailingNewline(data, end, size) )
+  {
+    int frameType = getFrameType(data + end);
+    if ( frameType > amrMaxFrameType && frameType != AMR_NO_DATA ) { countAMRError(AMR_ERROR_BAD_FRAME_TYPE); return -1; }
+    int frameBytes = getFrameBytes(frameType, type);
+    if ( end + frameBytes > size ) break; // the last frame is truncated.
+    if ( 1 + nbFrames + 1 + nFrameData + frameBytes - 1 > capacity ) { isFull = true; break; }
+    nFrameData += frameBytes - 1;
+    end += frameBytes;
+    nbFrames ++;
+  }
+  if ( nbFrames == 0 ) {
+    if ( !isFull ) *position = size; // no whole frame is left.
+    return 0;
+  }
+
+  // 0                   1                   2
+  // 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3
+  // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  // |  CMR  |R|R|R|R|1|  FT   |Q|P|P|0|  FT   |Q|P|P| frame data ...
+  // +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  uint8_t* toc = (uint8_t*) payload;
+  *toc++ = AMR_RTP_CMR_NONE << 4;
+  char* frameData = payload + 1 + nbFrames;
+  for (int k=0; k<nbFrames; k++)
+  {
+    int frameBytes = getFrameBytesDirect(data + i, type);
+    *toc++ = (data[i] & 0x7C) | ( (k < nbFrames - 1) ? 0x80 : 0 );
+    memcpy(frameData, data + i + 1, frameBytes - 1);
+    frameData += frameBytes - 1;
+    i += frameBytes;
+  }
+
+  *position = end;
+  return frameData - payload;
+}
+
+int amrDepacketize(const char* payload, int size, enum AMR_TYPE type, char* output, int capacity)
+{
+  // Skip the CMR.
+  if ( size < 2 ) { countAMRError(AMR_ERROR_SHORT_FRAME); return -AMR_ERROR_SHORT_FRAME; }
+  const uint8_t* packet = (const uint8_t*) payload + 1;
+  int nSize = size - 1;
+
+  int nTocLen = parseTocList(packet, nSize, type);
+  if ( nTocLen < 0 ) return nTocLen;
+  if ( nSize > capacity ) return 0; // one TOC per frame either way.
+
+  // Each TOC goes right before its frame data.
+  const int* frameSizes = (type==AMR_NB) ? amrnb_frame_sizes : amrwb_frame_sizes;
+  const uint8_t* frameData = packet + nTocLen;
+  for (int k=0; k<nTocLen; k++)
+  {
+    int frameSize = frameSizes[tocGetIndex(packet[k])];
+    *output++ = packet[k] & 0x7C; // clear the F bit and the padding bits.
+    memcpy(output, frameData, frameSize);
+    output += frameSize;
+    frameData += frameSize;
+  }
+
+  return nSize;
+}
+
 /* PCM to AMR NB */
 int pcm2amr_execute(char* data, unsigned int size, char* pOutput, void* amrEncoder, enum Mode amrMode)
 {
 	int nRet = 0;
 	int amrPTime = 20;
-	int amrDTX = 0;
+	int amrForceSpeech = 0; // the DTX itself is set at the init of the encoder.
 
 	unsigned int unitaryBuffSize = sizeof (int16_t) * AMRNB_NUM_SAMPLES;
 	unsigned int buffSize = unitaryBuffSize * amrPTime / 20;
@@ -229,13 +1031,13 @@ int pcm2amr_execute(char* data, unsigned int size, char* pOutput, void* amrEncod
   	unsigned int offset = 0;
 		for (offset = 0; offset < buffSize; offset += unitaryBuffSize)
 		{
-			int ret = Encoder_Interface_Encode(amrEncoder, amrMode, &samples[offset / sizeof (int16_t)], tmp, amrDTX);
+			int ret = Encoder_Interface_Encode(amrEncoder, amrMode, &samples[offset / sizeof (int16_t)], tmp, amrForceSpeech);
 			if (ret <= 0 || ret > 32){ printf("Encoder returned %i\n", ret); continue; }
 
 			int nFbit = tmp[0] >> 7;
 			nFbit = (offset+buffSize >= unitaryBuffSize) ? 0 : 1;
 			int nFTbits = tmp[0] >> 3 & 0x0F;
-			if(nFTbits > AMRNB_MAX_FRAME_TYPE){ printf("%s, Bad amr toc, index=%i (MAX=%d)\n", __func__, nFTbits, AMRNB_MAX_FRAME_TYPE); break; }
+			if(nFTbits > AMRNB_MAX_FRAME_TYPE && nFTbits != AMR_NO_DATA){ printf("%s, Bad amr toc, index=%i (MAX=%d)\n", __func__, nFTbits, AMRNB_MAX_FRAME_TYPE); break; }
 			int nQbit = tmp[0] >> 2 & 0x01;
 
 			// Frame
@@ -268,12 +1070,12 @@ int pcm2amr_execute(char* data, unsigned int size, char* pOutput, void* amrEncod
 	return nRet;
 }
 
-short* resampleTo8K(short* data, int size, int sampleRate, int* out_size)
+short* resampleTo(short* data, int size, int sampleRate, int targetRate, int* out_size)
 {
   float* data_in = (float*)malloc(sizeof(float)*size);
   for(int i=0; i<size; i++) data_in[i] = data[i];
 
-  double src_ratio = 1.0*8000/sampleRate;
+  double src_ratio = 1.0*targetRate/sampleRate;
   long output_frames = (int)(size*src_ratio);
 
   float* data_out = (float*)malloc(sizeof(float)*output_frames);
@@ -306,6 +1108,11 @@ short* resampleTo8K(short* data, int size, int sampleRate, int* out_size)
   return out_data;
 }
 
+short* resampleTo8K(short* data, int size, int sampleRate, int* out_size)
+{
+  return resampleTo(data, size, sampleRate, 8000, out_size);
+}
+
 enum Mode getAMRMode(int amrMode) {
   enum Mode mode = MR475;
   switch(amrMode) {
@@ -340,14 +1147,14 @@ enum Mode getAMRMode(int amrMode) {
   return mode;
 }
 
-char* pcm2amr(short* data, int size, int sampleRate, int* out_size, int amrMode)
+char* pcm2amr(short* data, int size, int sampleRate, int* out_size, int amrMode, bool dtx)
 {
   short* resampled = data;
   int new_size = size;
   if (sampleRate != 8000) resampled = resampleTo8K(data, size, sampleRate, &new_size);
 
   // amrnb_encode_init(nMode);
-  void* amrEncoder = Encoder_Interface_init(0);
+  void* amrEncoder = acquireAMREncoder(AMR_NB, dtx);
   uint8_t* output = (uint8_t*) malloc(size*sizeof(short));
 
   *out_size = pcm2amr_execute((char*)resampled, 2*new_size, (char*)output, amrEncoder, getAMRMode(amrMode));
@@ -361,14 +1168,124 @@ char* pcm2amr(short* data, int size, int sampleRate, int* out_size, int amrMode)
 	free(output);
 
   // amrnb_encode_uninit();
-  Encoder_Interface_exit(amrEncoder);
+  releaseAMREncoder(amrEncoder, AMR_NB, dtx);
 
   if (sampleRate != 8000 && resampled != NULL) free(resampled);
 
   return result;
 }
 
-char* wav2amr(char* data, int size, int* out_size, int mode)
+// Encode whole frames back to back in the storage format, i.e., the TOC followed by the frame data.
+// 'output' holds at least nbFrames * AMRNB_OUT_MAX_SIZE bytes. Returns the size written.
+static int amrEncodeFrames(void* amrEncoder, const short* pcm, int nbFrames, enum Mode amrMode, char* output)
+{
+  uint8_t frame[AMR_OUT_MAX_SIZE];
+  short samples[AMRNB_NUM_SAMPLES];
+  int size = 0;
+  for (int i=0; i<nbFrames; i++)
+  {
+    // The encoder filters its input in place (despite the const), and the frames before a chunk are also its neighbour's.
+    memcpy(samples, pcm + i * AMRNB_NUM_SAMPLES, sizeof(samples));
+    int ret = Encoder_Interface_Encode(amrEncoder, amrMode, samples, frame, 0);
+    if (ret <= 0 || ret > AMRNB_OUT_MAX_SIZE) continue;
+    if (output == NULL) continue; // only run the encoder.
+    frame[0] &= 0x7C; // clear the F bit and the padding bits.
+    memcpy(output + size, frame, ret);
+    size += ret;
+  }
+  return size;
+}
+
+char* pcm2amrParallel(short* data, int size, int sampleRate, int* out_size, int amrMode, bool dtx, int nbThreads, int warmUp)
+{
+  short* resampled = data;
+  int new_size = size;
+  if (sampleRate != 8000) resampled = resampleTo8K(data, size, sampleRate, &new_size);
+  if (resampled == NULL) { *out_size = 0; return NULL; }
+
+  // One chunk per thread, but not shorter than AMR_ENCODE_MIN_CHUNK frames.
+  int nbFrames = new_size / AMRNB_NUM_SAMPLES;
+  if (nbThreads <= 0) nbThreads = getThreadCount();
+  int nbChunks = std::max(1, std::min(nbThreads, nbFrames / AMR_ENCODE_MIN_CHUNK));
+  std::vector<std::vector<char> > chunks(nbChunks);
+
+  enum Mode mode = getAMRMode(amrMode);
+  parallelFor(nbChunks, nbThreads, [&](size_t c) {
+    int first = (int)((long long)nbFrames * c / nbChunks);
+    int last = (int)((long long)nbFrames * (c + 1) / nbChunks);
+    int nbWarmUp = std::min(first, std::max(0, warmUp));
+
+    void* amrEncoder = acquireAMREncoder(AMR_NB, dtx);
+    // Run the encoder over the frames right before the chunk, so that its state gets close to the serial one.
+    amrEncodeFrames(amrEncoder, resampled + (first - nbWarmUp) * AMRNB_NUM_SAMPLES, nbWarmUp, mode, NULL);
+    chunks[c].resize((last - first) * AMRNB_OUT_MAX_SIZE);
+    int written = amrEncodeFrames(amrEncoder, resampled + first * AMRNB_NUM_SAMPLES, last - first, mode, chunks[c].data());
+    chunks[c].resize(written);
+    releaseAMREncoder(amrEncoder, AMR_NB, dtx);
+  });
+
+  if (sampleRate != 8000) free(resampled);
+
+  // Concatenate the frames after the header.
+  int szHeader = strlen(AMRNB_HEADER);
+  *out_size = szHeader;
+  for (int c=0; c<nbChunks; c++) *out_size += chunks[c].size();
+  char* result = (char*) malloc(*out_size);
+  memcpy(result, AMRNB_HEADER, szHeader);
+  char* p = result + szHeader;
+  for (int c=0; c<nbChunks; c++)
+  {
+    if (!chunks[c].empty()) memcpy(p, chunks[c].data(), chunks[c].size());
+    p += chunks[c].size();
+  }
+
+  return result;
+}
+
+bool hasAMRWBEncoder()
+{
+#ifdef HAVE_AMRWB_ENCODER
+  return true;
+#else
+  return false;
+#endif
+}
+
+char* pcm2amrwb(short* data, int size, int sampleRate, int* out_size, int amrMode)
+{
+  *out_size = 0;
+  if (!hasAMRWBEncoder() || amrMode < 0 || amrMode > AMRWB_MAX_MODE) return NULL;
+
+  // 16 kHz is encoded as is.
+  short* resampled = data;
+  int new_size = size;
+  if (sampleRate != 16000) resampled = resampleTo(data, size, sampleRate, 16000, &new_size);
+  if (resampled == NULL) return NULL;
+
+  void* amrEncoder = acquireAMREncoder(AMR_WB);
+
+  // The header and the frames are written straight into the result.
+  int nbFrames = new_size / AMRWB_NUM_SAMPLES;
+  int szHeader = strlen(AMRWB_HEADER);
+  char* result = (char*) malloc(szHeader + nbFrames * AMRWB_OUT_MAX_SIZE);
+  memcpy(result, AMRWB_HEADER, szHeader);
+  *out_size = szHeader;
+  for (int i=0; i<nbFrames; i++)
+  {
+#ifdef HAVE_AMRWB_ENCODER
+    int bytes = E_IF_encode(amrEncoder, amrMode, resampled + i * AMRWB_NUM_SAMPLES, (unsigned char*)result + *out_size, 0);
+    if (bytes > 0) *out_size += bytes;
+#endif
+  }
+
+  releaseAMREncoder(amrEncoder, AMR_WB);
+
+  if (sampleRate != 16000) free(resampled);
+
+  return result;
+}
+
+char* wav2amr(char* data, int size, int* out_size, int mode, bool dtx)
 {
   // Read the sampleRate
   short* pValue = (short*) (data + 24);
@@ -376,7 +1293,7 @@ char* wav2amr(char* data, int size, int* out_size, int mode)
   // Skip the WAVE header, which is 44-byte long.
   short* pPCMData = (short*) (data+44);
   int nbSamples = (size-44)/2;
-  return pcm2amr(pPCMData, nbSamples, sampleRate, out_size, mode);
+  return pcm2amr(pPCMData, nbSamples, sampleRate, out_size, mode, dtx);
 }
 
 char* mp32amr(short* data, int size, int* out_size, int mode)
@@ -388,7 +1305,123 @@ char* mp32amr(short* data, int size, int* out_size, int mode)
   int samples = info.samples;
   if(samples == 0 ) return NULL;
 
-  return pcm2amr(info.buffer, info.samples, info.hz, out_size, mode);
+#ifdef MINIMP3_FLOAT_OUTPUT
+  short* pcm = new short[samples];
+  mp3dec_f32_to_s16(info.buffer, pcm, samples);
+  free(info.buffer);
+  char* amr = pcm2amr(pcm, samples, info.hz, out_size, mode);
+  delete [] pcm;
+  return amr;
+#else
+  char* amr = pcm2amr(info.buffer, samples, info.hz, out_size, mode);
+  free(info.buffer);
+  return amr;
+#endif
+
+}
+
+
+
+AmrEncoder::AmrEncoder(int sampleRate, int mode)
+  : m_sampleRate(sampleRate), m_mode(mode), m_encoder(NULL), m_resampler(NULL), m_isStarted(false), m_nbBlock(0)
+{
+  m_encoder = acquireAMREncoder();
+
+  int error = 0;
+  if (m_sampleRate != 8000) m_resampler = src_new(SRC_SINC_FASTEST, 1, &error);
+}
+
+AmrEncoder::~AmrEncoder()
+{
+  releaseAMREncoder(m_encoder);
+  if (m_resampler != NULL) src_delete(m_resampler);
+}
+
+void AmrEncoder::reset()
+{
+  // The released encoder is reset by the pool.
+  releaseAMREncoder(m_encoder);
+  m_encoder = acquireAMREncoder();
+  if (m_resampler != NULL) src_reset(m_resampler);
+  m_isStarted = false;
+  m_nbBlock = 0;
+}
+
+void AmrEncoder::encodeBlock(std::vector<char> &amr)
+{
+  uint8_t frame[AMR_OUT_MAX_SIZE];
+  int bytes = Encoder_Interface_Encode(m_encoder, getAMRMode(m_mode), m_block, frame, 0);
+  if (bytes > 0) amr.insert(amr.end(), (char*)frame, (char*)frame + bytes);
+  m_nbBlock = 0;
+}
 
+void AmrEncoder::addSamples(const float* data, size_t length, std::vector<char> &amr)
+{
+  for (size_t i=0; i<length; i++)
+  {
+    float value = data[i] * 32768;
+    m_block[m_nbBlock++] = (value >= 32767) ? 32767 : ( (value <= -32768) ? -32768 : (short) value );
+    if (m_nbBlock == AMRNB_FRAME_SAMPLES) encodeBlock(amr);
+  }
 }
 
+int AmrEncoder::resample(const float* data, size_t length, bool isLast, std::vector<char> &amr)
+{
+  static const float empty = 0;
+  if (data == NULL) data = &empty; // the resampler rejects a NULL input, even an empty one.
+
+  SRC_DATA src_data;
+  src_data.src_ratio = 8000.0 / m_sampleRate;
+  src_data.end_of_input = isLast ? 1 : 0;
+
+  // Run the resampler until it has used all the input and has nothing more to give.
+  while (true)
+  {
+    src_data.data_in = (float*) data;
+    src_data.input_frames = length;
+    src_data.data_out = m_resampled;
+    src_data.output_frames = AMR_ENCODER_BLOCK;
+    if (src_process(m_resampler, &src_data) != 0) return -1;
+
+    addSamples(m_resampled, src_data.output_frames_gen, amr);
+    data += src_data.input_frames_used;
+    length -= src_data.input_frames_used;
+    if (length == 0 && src_data.output_frames_gen == 0) break;
+  }
+
+  return 0;
+}
+
+int AmrEncoder::process(const float* data, size_t length, std::vector<char> &amr)
+{
+  if (!m_isStarted)
+  {
+    amr.insert(amr.end(), AMRNB_HEADER, AMRNB_HEADER + strlen(AMRNB_HEADER));
+    m_isStarted = true;
+  }
+
+  if (m_sampleRate == 8000) { addSamples(data, length, amr); return 0; }
+  if (m_resampler == NULL) return -1;
+
+  return resample(data, length, false, amr);
+}
+
+int AmrEncoder::flush(std::vector<char> &amr)
+{
+  int rc = 0;
+  if (m_isStarted)
+  {
+    if (m_resampler != NULL) rc = resample(NULL, 0, true, amr);
+
+    // Pad the last block with zeros.
+    if (m_nbBlock > 0)
+    {
+      memset(m_block + m_nbBlock, 0, (AMRNB_FRAME_SAMPLES - m_nbBlock) * sizeof(short));
+      encodeBlock(amr);
+    }
+  }
+
+  reset();
+
+  return rc;
+}
@@ -11,6 +11,7 @@
  ************************************************/
 
 #include <algorithm> 
+#include <chrono>
 #include <complex>
 #include <cmath>
 #include <dirent.h> 
@@ -23,6 +24,7 @@
 #include "AudioFile.h"
 #include "ffts.h"
 #include "pitch_detection.h"
+#include "pitch.h"
 #include "mfcc.h"
 #include "amr.h"
 #include "minimp3.h"
@@ -96,6 +98,23 @@ void pitch_detection (const char* filename)
   }
 }
 
+void pitch_ensemble_test(const char* filename)
+{
+  AudioFile<float> audioFile;
+  audioFile.load(filename);
+  int sampleRate = audioFile.getSampleRate();
+
+  std::vector<std::vector<float>> buffer = audioFile.samples;
+  if(buffer.size()==0) return;
+
+  // We only use the first channel
+  PitchEnsemble ensemble = computePitchEnsemble(buffer[0].data(), buffer[0].size(), sampleRate, PITCH_METHOD_ALL);
+  printf("pitch [acorr] = %f\n", ensemble.pitches[PITCH_IDX_ACORR]);
+  printf("pitch [yin] = %f\n", ensemble.pitches[PITCH_IDX_YIN]);
+  printf("pitch [mpm] = %f\n", ensemble.pitches[PITCH_IDX_MPM]);
+  printf("pitch [fused] = %f\n", ensemble.pitch);
+}
+
 void mfcc_test ()
 {
   std::string wavFileName = "../wav/OSR_us_000_0010_8k.wav";
@@ -155,6 +174,26 @@ void amr_test()
   fclose(fp);
 }
 
+void amr_stream_test()
+{
+  FILE *fp = NULL;
+  if (!(fp = fopen("../wav/sample.amr", "rb"))) return;
+
+  // Decode the file 100 bytes at a time, as if it came from a socket.
+  AmrDecoder decoder;
+  std::vector<short> pcm;
+  char chunk[100];
+  size_t sz = 0;
+  while ((sz = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+  {
+    pcm.clear();
+    if (decoder.process(chunk, sz, pcm) < 0) break;
+    printf("%zu samples at %d Hz\n", pcm.size(), decoder.getSampleRate());
+  }
+
+  fclose(fp);
+}
+
 void wav2amr_test()
 {
 //  char szInputFileName[] = "../wav/OSR_us_000_0010_8k.wav";
@@ -230,6 +269,132 @@ void mp32amr_test()
 
 }
 
+// Read the wav files of the directory (sorted by name), resampled to 8 kHz, back to back.
+static std::vector<short> loadSpeech8K(const char* directory)
+{
+  std::vector<std::string> names;
+  DIR* dir = opendir(directory);
+  if (!dir) return std::vector<short>();
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".wav") == 0) names.push_back(name);
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  std::vector<short> speech;
+  for (size_t i=0; i<names.size(); i++)
+  {
+    AudioFile<float> audioFile;
+    if (!audioFile.load(std::string(directory) + "/" + names[i]) || audioFile.samples.empty()) continue;
+    std::vector<float> &input = audioFile.samples[0];
+    std::vector<float> output(input.size() * 8000 / audioFile.getSampleRate() + 1);
+
+    SRC_DATA src_data;
+    memset(&src_data, 0, sizeof(src_data));
+    src_data.data_in = input.data();
+    src_data.data_out = output.data();
+    src_data.input_frames = input.size();
+    src_data.output_frames = output.size();
+    src_data.src_ratio = 8000.0 / audioFile.getSampleRate();
+    if (src_simple(&src_data, SRC_SINC_FASTEST, 1) != 0) continue;
+
+    for (long k=0; k<src_data.output_frames_gen; k++) speech.push_back((short)(std::max(-1.0f, std::min(1.0f, output[k])) * 32767));
+    printf("amr_parallel_quality: %s, %.1f s\n", names[i].c_str(), src_data.output_frames_gen / 8000.0);
+  }
+  return speech;
+}
+
+// Decode the AMR data, and free it.
+static std::vector<short> decodeAMR(char* amr, int size)
+{
+  int nbSamples = getSampleCount(amr, size, AMR_NB);
+  short* pcm = amr2pcm(amr, size);
+  std::vector<short> decoded(pcm, pcm + nbSamples);
+  free(pcm);
+  free(amr);
+  return decoded;
+}
+
+// Measure the quality of pcm2amrParallel() after the seams, relative to pcm2amr(), for several warm-ups (the table of README 3.1.2).
+// The wav files of the directory are encoded at 12.2k in as many chunks as they allow (AMR_ENCODE_MIN_CHUNK frames each).
+// The start is rotated 'nbRotations' times so that the seams fall on different speech.
+// The quality is the waveform SNR of the decoded speech against the input, in the windows right after the seams.
+void amr_parallel_quality(const char* directory, int nbRotations = 8)
+{
+  std::vector<short> speech = loadSpeech8K(directory);
+  int nbFrames = speech.size() / 160;
+  int nbChunks = std::min(8, nbFrames / AMR_ENCODE_MIN_CHUNK);
+  if (nbChunks < 2) { printf("amr_parallel_quality: not enough speech for a seam.\n"); return; }
+  speech.resize(nbFrames * 160);
+
+  const int warmUps[] = { 0, AMR_ENCODE_WARM_UP, 25, 50 };
+  const int windows[] = { 800, 4000, 40000 }; // 100 ms, 500 ms, 5 s
+  const size_t delay = 40; // the decoded speech lags the input by the 5 ms look-ahead of the encoder
+  for (int dtx=0; dtx<2; dtx++)
+  {
+    // The SNR of the parallel encoding minus the one of the serial encoding, per warm-up and window, for each seam.
+    std::vector<double> gains[4][3];
+    for (int r=0; r<nbRotations; r++)
+    {
+      std::vector<short> input(speech.size());
+      std::rotate_copy(speech.begin(), speech.begin() + (size_t)nbFrames * r / nbRotations * 160, speech.end(), input.begin());
+
+      int size = 0;
+      char* amr = pcm2amr(input.data(), input.size(), 8000, &size, 7, dtx);
+      std::vector<short> serial = decodeAMR(amr, size);
+      if (r == 0)
+      {
+        double signal = 0, error = 0;
+        for (size_t i=0; i+delay<serial.size(); i++)
+        {
+          signal += (double)input[i] * input[i];
+          error += (double)(serial[i+delay] - input[i]) * (serial[i+delay] - input[i]);
+        }
+        printf("amr_parallel_quality: DTX %s, the SNR of pcm2amr() is %.2f dB\n", dtx ? "on" : "off", 10 * log10(signal / error));
+      }
+      for (int w=0; w<4; w++)
+      {
+        amr = pcm2amrParallel(input.data(), input.size(), 8000, &size, 7, dtx, nbChunks, warmUps[w]);
+        std::vector<short> parallel = decodeAMR(amr, size);
+        if (parallel.size() != serial.size()) { printf("amr_parallel_quality: the frame counts differ.\n"); return; }
+        for (int c=1; c<nbChunks; c++)
+        {
+          size_t seam = (size_t)((long long)nbFrames * c / nbChunks) * 160;
+          for (int k=0; k<3; k++)
+          {
+            double errorSerial = 0, errorParallel = 0;
+            for (size_t i=seam; i<std::min(serial.size() - delay, seam + windows[k]); i++)
+            {
+              errorSerial += (double)(serial[i+delay] - input[i]) * (serial[i+delay] - input[i]);
+              errorParallel += (double)(parallel[i+delay] - input[i]) * (parallel[i+delay] - input[i]);
+            }
+            // With the same input, the SNR difference is the ratio of the errors.
+            gains[w][k].push_back(10 * log10((errorSerial + 1) / (errorParallel + 1)));
+          }
+        }
+      }
+    }
+
+    printf("amr_parallel_quality: %.1f s, %d chunks, %d seams, DTX %s, 12.2k, relative to pcm2amr():\n",
+           speech.size() / 8000.0, nbChunks, (int)gains[0][0].size(), dtx ? "on" : "off");
+    printf("| Warm-up | first 100 ms after a seam | first 500 ms | first 5 s |\n");
+    for (int w=0; w<4; w++)
+    {
+      printf("| %d frames |", warmUps[w]);
+      for (int k=0; k<3; k++)
+      {
+        double sum = 0;
+        for (size_t i=0; i<gains[w][k].size(); i++) sum += gains[w][k][i];
+        printf(" %+.2f dB |", sum / gains[w][k].size());
+      }
+      printf("\n");
+    }
+  }
+}
+
 void mp3_test(const char* fileName)
 {
   // Convert MP3 data
@@ -243,12 +408,53 @@ void mp3_test(const char* fileName)
   printf("mp3_test: avg_bitrate_kbps = %d\n", info.avg_bitrate_kbps);
   int samples = info.samples;
   if(samples == 0 ) return;
-  short* pcm = info.buffer;
+  free(info.buffer);
 
   int sampleRate = info.hz;
   printf("mp3_test: Sample rate = %d\n", sampleRate);
 }
 
+// Decode the file many times with the scalar and the SIMD paths of minimp3, and report the frames per second.
+void mp3_benchmark(const char* fileName, int nbRepeats = 200)
+{
+  FILE* fp = fopen(fileName, "rb");
+  if (!fp) return;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  std::vector<uint8_t> mp3(size);
+  size_t nbRead = fread(mp3.data(), 1, size, fp);
+  fclose(fp);
+  if (nbRead != (size_t)size) return;
+
+  mp3d_sample_t pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+  mp3dec_frame_info_t info;
+  mp3dec_t mp3d;
+  for (int simd=0; simd<2; simd++)
+  {
+    int enabled = mp3dec_simd_enable(simd);
+    if (simd && !enabled) { printf("mp3_benchmark: SIMD is not available.\n"); break; }
+
+    long nbFrames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int k=0; k<nbRepeats; k++)
+    {
+      mp3dec_init(&mp3d);
+      size_t offset = mp3dec_skip_id3v2(mp3.data(), mp3.size());
+      while (offset < mp3.size())
+      {
+        int samples = mp3dec_decode_frame(&mp3d, mp3.data() + offset, mp3.size() - offset, pcm, &info);
+        if (info.frame_bytes == 0) break;
+        offset += info.frame_bytes;
+        if (samples > 0) nbFrames++;
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("mp3_benchmark: %-6s %ld frames in %.3f s, %.0f frames/s\n", simd ? "SIMD" : "scalar", nbFrames, seconds, nbFrames / seconds);
+  }
+  mp3dec_simd_enable(1);
+}
+
 void denoise_test(const char* fileName)
 {
   AudioFile<float> audioFile;
@@ -344,14 +550,22 @@ int main (int argc, char *argv[])
 
   // pitch_detection("../wav/female.wav");
 
+  // pitch_ensemble_test("../wav/female.wav");
+
   // mfcc_test();
 
   // mp3_test("../wav/t2.mp3");
 
+  // mp3_benchmark("../wav/t2.mp3");
+
   // denoise_test("../wav/noisy.wav");
 
 //  resample_test("../wav/female.wav");
 
+  // amr_stream_test();
+
+  // amr_parallel_quality("../wav");
+
   wav2amr_test();
 
 //  mp32amr_test();
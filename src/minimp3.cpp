@@ -16,8 +16,119 @@
 
 #include "minimp3.h"
 
+#if !defined(MINIMP3_NO_SIMD)
+
+#if (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))) || ((defined(__i386__) || defined(__x86_64__)) && defined(__SSE2__))
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else /* defined(_MSC_VER) */
+#include <cpuid.h>
+#endif /* defined(_MSC_VER) */
+#include <immintrin.h>
+#define HAVE_SSE 1
+#define HAVE_SIMD 1
+#define VSTORE _mm_storeu_ps
+#define VLD _mm_loadu_ps
+#define VSET _mm_set1_ps
+#define VADD _mm_add_ps
+#define VSUB _mm_sub_ps
+#define VMUL _mm_mul_ps
+#define VMAC(a, x, y) _mm_add_ps(a, _mm_mul_ps(x, y))
+#define VMSB(a, x, y) _mm_sub_ps(a, _mm_mul_ps(x, y))
+#define VMUL_S(x, s)  _mm_mul_ps(x, _mm_set1_ps(s))
+#define VREV(x) _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 1, 2, 3))
+typedef __m128 f4;
+static void minimp3_cpuid(int CPUInfo[], const int InfoType)
+{
+#if defined(_MSC_VER)
+    __cpuid(CPUInfo, InfoType);
+#else /* defined(_MSC_VER) */
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    __get_cpuid(InfoType, &a, &b, &c, &d);
+    CPUInfo[0] = a; CPUInfo[1] = b; CPUInfo[2] = c; CPUInfo[3] = d;
+#endif /* defined(_MSC_VER) */
+}
+static int cpu_have_simd(void)
+{
+    int CPUInfo[4];
+    minimp3_cpuid(CPUInfo, 0);
+    if (CPUInfo[0] <= 0)
+        return 0;
+    minimp3_cpuid(CPUInfo, 1);
+    return (CPUInfo[3] & (1 << 26)) != 0; /* SSE2 */
+}
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif /* defined(__linux__) */
+#define HAVE_SSE 0
+#define HAVE_SIMD 1
+#define VSTORE vst1q_f32
+#define VLD vld1q_f32
+#define VSET vmovq_n_f32
+#define VADD vaddq_f32
+#define VSUB vsubq_f32
+#define VMUL vmulq_f32
+#define VMAC(a, x, y) vmlaq_f32(a, x, y)
+#define VMSB(a, x, y) vmlsq_f32(a, x, y)
+#define VMUL_S(x, s)  vmulq_f32(x, vmovq_n_f32(s))
+#define VREV(x) vcombine_f32(vget_high_f32(vrev64q_f32(x)), vget_low_f32(vrev64q_f32(x)))
+typedef float32x4_t f4;
+static int cpu_have_simd(void)
+{
+#if defined(__linux__) && defined(__aarch64__)
+    return (getauxval(AT_HWCAP) & (1 << 1)) != 0; /* HWCAP_ASIMD */
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & (1 << 12)) != 0; /* HWCAP_NEON */
+#else /* defined(__linux__) */
+    return 1; /* No portable check elsewhere: trust the compiler flags. */
+#endif /* defined(__linux__) */
+}
+#else /* SIMD checks... */
+#define HAVE_SSE 0
+#define HAVE_SIMD 0
+#ifdef MINIMP3_ONLY_SIMD
+#error MINIMP3_ONLY_SIMD used, but SSE/NEON not enabled
+#endif /* MINIMP3_ONLY_SIMD */
+#endif /* SIMD checks... */
+
+#else /* !defined(MINIMP3_NO_SIMD) */
+#define HAVE_SIMD 0
+#endif /* !defined(MINIMP3_NO_SIMD) */
+
+#if HAVE_SIMD
+/* 0: not checked yet, 1: scalar, 2: SIMD. */
+static volatile int g_have_simd;
+
+static int have_simd(void)
+{
+#ifdef MINIMP3_ONLY_SIMD
+    return 1;
+#else /* MINIMP3_ONLY_SIMD */
+    if (!g_have_simd)
+        g_have_simd = cpu_have_simd() + 1;
+    return g_have_simd - 1;
+#endif /* MINIMP3_ONLY_SIMD */
+}
+#endif /* HAVE_SIMD */
 
-static size_t mp3dec_skip_id3v2(const uint8_t *buf, size_t buf_size)
+int mp3dec_simd_enable(int enable)
+{
+#if HAVE_SIMD && !defined(MINIMP3_ONLY_SIMD)
+    g_have_simd = (enable && cpu_have_simd()) + 1;
+    return g_have_simd - 1;
+#elif HAVE_SIMD
+    (void)enable;
+    return 1;
+#else /* HAVE_SIMD */
+    (void)enable;
+    return 0;
+#endif /* HAVE_SIMD */
+}
+
+
+size_t mp3dec_skip_id3v2(const uint8_t *buf, size_t buf_size)
 {
     if (buf_size > 10 && !strncmp((char *)buf, "ID3", 3))
     {
@@ -1172,6 +1283,7 @@ static void mp3d_DCT_II(float *grbuf, int n)
 #endif /* MINIMP3_ONLY_SIMD */
 }
 
+#ifndef MINIMP3_FLOAT_OUTPUT
 static int16_t mp3d_scale_pcm(float sample)
 {
     if (sample >=  32766.5) return (int16_t) 32767;
@@ -1180,6 +1292,12 @@ static int16_t mp3d_scale_pcm(float sample)
     s -= (s < 0);   /* away from zero, to be compliant */
     return s;
 }
+#else /* MINIMP3_FLOAT_OUTPUT */
+static float mp3d_scale_pcm(float sample)
+{
+    return sample*(1.f/32768.f);
+}
+#endif /* MINIMP3_FLOAT_OUTPUT */
 
 static void mp3d_synth_pair(mp3d_sample_t *pcm, int nch, const float *z)
 {
@@ -1438,7 +1556,7 @@ static int mp3d_find_frame(const uint8_t *mp3, int mp3_bytes, int *free_format_b
     return i;
 }
 
-static int mp3dec_open_file(const char *file_name, mp3dec_map_info_t *map_info)
+static int mp3dec_map_file(const char *file_name, mp3dec_map_info_t *map_info, int lazy)
 {
     int file;
     struct stat st;
@@ -1455,16 +1573,33 @@ retry_open:
 
     map_info->size = st.st_size;
 retry_mmap:
-    map_info->buffer = (const uint8_t*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, file, 0);
+    map_info->buffer = (const uint8_t*) mmap(NULL, st.st_size, PROT_READ, lazy ? MAP_PRIVATE : (MAP_PRIVATE | MAP_POPULATE), file, 0);
     if (MAP_FAILED == map_info->buffer && (errno == EAGAIN || errno == EINTR))
         goto retry_mmap;
+    if (MAP_FAILED != map_info->buffer && lazy && madvise((void *)map_info->buffer, map_info->size, MADV_SEQUENTIAL) < 0)
+    {
+        /* Without the read-ahead hint, fault the whole file in up front as mp3dec_open_file() does. */
+        munmap((void *)map_info->buffer, map_info->size);
+        lazy = 0;
+        goto retry_mmap;
+    }
     close(file);
     if (MAP_FAILED == map_info->buffer)
         return -1;
     return 0;
 }
 
-static void mp3dec_close_file(mp3dec_map_info_t *map_info)
+int mp3dec_open_file(const char *file_name, mp3dec_map_info_t *map_info)
+{
+    return mp3dec_map_file(file_name, map_info, 0);
+}
+
+int mp3dec_open_file_lazy(const char *file_name, mp3dec_map_info_t *map_info)
+{
+    return mp3dec_map_file(file_name, map_info, 1);
+}
+
+void mp3dec_close_file(mp3dec_map_info_t *map_info)
 {
     if (map_info->buffer && MAP_FAILED != map_info->buffer)
         munmap((void *)map_info->buffer, map_info->size);
@@ -1481,60 +1616,41 @@ void mp3dec_init(mp3dec_t *dec)
 }
 
 
-void mp3dec_load_buf(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3dec_file_info_t *info, MP3D_PROGRESS_CB progress_cb, void *user_data)
+/* Decode the frames into info->buffer, which holds 'capacity' samples (channels included).
+   The frames are decoded in place while a whole frame fits, and the tail through 'pcm'.
+   When a frame does not fit, the buffer is grown if 'grow', otherwise it stops and returns -1. */
+static int mp3dec_load_frames(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3dec_file_info_t *info, size_t capacity, int grow, MP3D_PROGRESS_CB progress_cb, void *user_data)
 {
     size_t orig_buf_size = buf_size;
     mp3d_sample_t pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
     mp3dec_frame_info_t frame_info;
-    memset(info, 0, sizeof(*info));
     memset(&frame_info, 0, sizeof(frame_info));
     /* skip id3v2 */
     size_t id3v2size = mp3dec_skip_id3v2(buf, buf_size);
     if (id3v2size > buf_size)
-        return;
+        return 0;
     buf      += id3v2size;
     buf_size -= id3v2size;
-    /* try to make allocation size assumption by first frame */
     mp3dec_init(dec);
-    int samples;
-    do
-    {
-        samples = mp3dec_decode_frame(dec, buf, buf_size, pcm, &frame_info);
-        buf      += frame_info.frame_bytes;
-        buf_size -= frame_info.frame_bytes;
-        if (samples)
-            break;
-    } while (frame_info.frame_bytes);
-    if (!samples)
-        return;
-    samples *= frame_info.channels;
-    size_t allocated = (buf_size/frame_info.frame_bytes)*samples*sizeof(mp3d_sample_t) + MINIMP3_MAX_SAMPLES_PER_FRAME*sizeof(mp3d_sample_t);
-    info->buffer = (mp3d_sample_t*) malloc(allocated);
-    if (!info->buffer)
-        return;
-    info->samples = samples;
-    memcpy(info->buffer, pcm, info->samples*sizeof(mp3d_sample_t));
-    /* save info */
-    info->channels = frame_info.channels;
-    info->hz       = frame_info.hz;
-    info->layer    = frame_info.layer;
-    size_t avg_bitrate_kbps = frame_info.bitrate_kbps;
-    size_t frames = 1;
-    /* decode rest frames */
-    int frame_bytes;
+    size_t avg_bitrate_kbps = 0, frames = 0;
+    int samples, frame_bytes, ret = 0;
     do
     {
-        if ((allocated - info->samples*sizeof(mp3d_sample_t)) < MINIMP3_MAX_SAMPLES_PER_FRAME*sizeof(mp3d_sample_t))
-        {
-            allocated *= 2;
-            info->buffer = (mp3d_sample_t*) realloc(info->buffer, allocated);
-        }
-        samples = mp3dec_decode_frame(dec, buf, buf_size, info->buffer + info->samples, &frame_info);
+        size_t room = capacity - info->samples;
+        mp3d_sample_t *out = (room >= MINIMP3_MAX_SAMPLES_PER_FRAME) ? info->buffer + info->samples : pcm;
+        samples = mp3dec_decode_frame(dec, buf, buf_size, out, &frame_info);
         frame_bytes = frame_info.frame_bytes;
         buf      += frame_bytes;
         buf_size -= frame_bytes;
         if (samples)
         {
+            if (!frames)
+            {
+                /* save info */
+                info->channels = frame_info.channels;
+                info->hz       = frame_info.hz;
+                info->layer    = frame_info.layer;
+            }
             if (info->hz != frame_info.hz || info->layer != frame_info.layer)
                 break;
             if (info->channels && info->channels != frame_info.channels)
@@ -1543,17 +1659,66 @@ void mp3dec_load_buf(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3dec_
 #else
                 break;
 #endif
-            info->samples += samples*frame_info.channels;
+            samples *= frame_info.channels;
+            if (out == pcm)
+            {
+                if ((size_t)samples > room)
+                {
+                    if (!grow)
+                    {
+                        ret = -1;
+                        break;
+                    }
+                    capacity = MINIMP3_MAX(capacity*2, info->samples + MINIMP3_MAX_SAMPLES_PER_FRAME);
+                    info->buffer = (mp3d_sample_t*) realloc(info->buffer, capacity*sizeof(mp3d_sample_t));
+                    if (!info->buffer)
+                    {
+                        info->samples = 0;
+                        return 0;
+                    }
+                }
+                memcpy(info->buffer + info->samples, pcm, samples*sizeof(mp3d_sample_t));
+            }
+            info->samples += samples;
             avg_bitrate_kbps += frame_info.bitrate_kbps;
             frames++;
             if (progress_cb)
                 progress_cb(user_data, orig_buf_size, orig_buf_size - buf_size, &frame_info);
         }
     } while (frame_bytes);
+    if (frames)
+        info->avg_bitrate_kbps = avg_bitrate_kbps/frames;
+    return ret;
+}
+
+void mp3dec_load_buf(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3dec_file_info_t *info, MP3D_PROGRESS_CB progress_cb, void *user_data)
+{
+    memset(info, 0, sizeof(*info));
+    /* The header scan sizes the buffer once: no reallocation, unless the stream is corrupted. */
+    size_t capacity = mp3dec_count_samples(buf, buf_size);
+    if (capacity)
+    {
+        info->buffer = (mp3d_sample_t*) malloc(capacity*sizeof(mp3d_sample_t));
+        if (!info->buffer)
+            return;
+    }
+    mp3dec_load_frames(dec, buf, buf_size, info, capacity, 1, progress_cb, user_data);
+    if (!info->samples)
+    {
+        free(info->buffer);
+        memset(info, 0, sizeof(*info));
+        return;
+    }
     /* reallocate to normal buffer size */
-    if (allocated != info->samples*sizeof(mp3d_sample_t))
+    if (info->buffer && capacity != info->samples)
         info->buffer = (mp3d_sample_t*) realloc(info->buffer, info->samples*sizeof(mp3d_sample_t));
-    info->avg_bitrate_kbps = avg_bitrate_kbps/frames;
+}
+
+int mp3dec_load_buf_into(mp3dec_t *dec, const uint8_t *buf, size_t buf_size, mp3d_sample_t *pcm, size_t max_samples, mp3dec_file_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->buffer = pcm;
+    return mp3dec_load_frames(dec, buf, buf_size, info, max_samples, 0, 0, 0);
 }
 
 int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info)
@@ -1650,6 +1815,172 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
     return success*hdr_frame_samples(dec->header);
 }
 
+static uint32_t mp3d_read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Check the first frame for a Xing/Info (after the side info) or a VBRI (32 bytes after the header) tag. */
+static int mp3d_read_vbr_tag(const uint8_t *hdr, int frame_bytes, size_t *tag_frames)
+{
+    int side_info = HDR_TEST_MPEG1(hdr) ? (HDR_IS_MONO(hdr) ? 17 : 32) : (HDR_IS_MONO(hdr) ? 9 : 17);
+    int offset = HDR_SIZE + (HDR_IS_CRC(hdr) ? 2 : 0) + side_info;
+    if (4 - HDR_GET_LAYER(hdr) == 3 && offset + 12 <= frame_bytes &&
+        (!memcmp(hdr + offset, "Xing", 4) || !memcmp(hdr + offset, "Info", 4)))
+    {
+        uint32_t flags = mp3d_read_be32(hdr + offset + 4);
+        *tag_frames = (flags & 1) ? mp3d_read_be32(hdr + offset + 8) : 0;
+        return MP3D_TAG_XING;
+    }
+    offset = HDR_SIZE + 32;
+    if (offset + 18 <= frame_bytes && !memcmp(hdr + offset, "VBRI", 4))
+    {
+        *tag_frames = mp3d_read_be32(hdr + offset + 14);
+        return MP3D_TAG_VBRI;
+    }
+    return MP3D_TAG_NONE;
+}
+
+int mp3dec_frame_samples(const uint8_t *hdr)
+{
+    return hdr_frame_samples(hdr);
+}
+
+/* Walk from 'offset'. If 'resume', the frame at 'offset' is taken as the one right after the last frame walked,
+   i.e., only the next header is checked, instead of MAX_FRAME_SYNC_MATCHES frames in a row. */
+static int mp3d_iterate(const uint8_t *buf, size_t buf_size, size_t offset, int resume, MP3D_ITERATE_CB callback, void *user_data)
+{
+    const uint8_t *orig_buf = buf;
+    buf      += offset;
+    buf_size -= offset;
+
+    /* Only the headers are read: the sync is the same as mp3dec_decode_frame(), without its decoder state. */
+    uint8_t header[HDR_SIZE] = { 0 };
+    if (resume && buf_size > HDR_SIZE)
+        memcpy(header, buf, HDR_SIZE);
+    int free_format_bytes = 0;
+    mp3dec_frame_info_t first;
+    memset(&first, 0, sizeof(first));
+    while (buf_size > HDR_SIZE)
+    {
+        int i = 0, frame_size = 0;
+        int mp3_bytes = (int)MINIMP3_MIN(buf_size, (size_t)0x7fffffff);
+        if (header[0] == 0xff && hdr_compare(header, buf))
+        {
+            frame_size = hdr_frame_bytes(buf, free_format_bytes) + hdr_padding(buf);
+            if (frame_size != mp3_bytes && (frame_size + HDR_SIZE > mp3_bytes || !hdr_compare(buf, buf + frame_size)))
+                frame_size = 0;
+        }
+        if (!frame_size)
+        {
+            free_format_bytes = 0;
+            i = mp3d_find_frame(buf, mp3_bytes, &free_format_bytes, &frame_size);
+            if (!frame_size || i + frame_size > mp3_bytes)
+                break;
+        }
+
+        const uint8_t *hdr = buf + i;
+        mp3dec_frame_info_t info;
+        info.frame_bytes  = frame_size;
+        info.channels     = HDR_IS_MONO(hdr) ? 1 : 2;
+        info.hz           = hdr_sample_rate_hz(hdr);
+        info.layer        = 4 - HDR_GET_LAYER(hdr);
+        info.bitrate_kbps = hdr_bitrate_kbps(hdr);
+        if (!first.hz)
+            first = info;
+        else if (first.hz != info.hz || first.layer != info.layer || first.channels != info.channels)
+            break; /* as mp3dec_load_buf() */
+
+        int ret = callback(user_data, hdr, frame_size, hdr - orig_buf, &info);
+        if (ret)
+            return ret;
+        memcpy(header, hdr, HDR_SIZE);
+        buf      += i + frame_size;
+        buf_size -= i + frame_size;
+    }
+    return 0;
+}
+
+int mp3dec_iterate_buf(const uint8_t *buf, size_t buf_size, MP3D_ITERATE_CB callback, void *user_data)
+{
+    size_t id3v2size = mp3dec_skip_id3v2(buf, buf_size);
+    if (id3v2size > buf_size)
+        return 0;
+    return mp3d_iterate(buf, buf_size, id3v2size, 0, callback, user_data);
+}
+
+int mp3dec_iterate_buf_from(const uint8_t *buf, size_t buf_size, size_t offset, MP3D_ITERATE_CB callback, void *user_data)
+{
+    if (offset >= buf_size)
+        return 0;
+    return mp3d_iterate(buf, buf_size, offset, 1, callback, user_data);
+}
+
+static int mp3d_probe_frame(void *user_data, const uint8_t *hdr, int frame_size, size_t offset, mp3dec_frame_info_t *frame_info)
+{
+    mp3dec_probe_info_t *info = (mp3dec_probe_info_t *)user_data;
+    (void)offset;
+    if (!info->hz)
+    {
+        info->hz = frame_info->hz;
+        info->layer = frame_info->layer;
+        info->channels = frame_info->channels;
+        /* The tag takes the place of the first frame, which holds no audio. */
+        info->vbr_tag = mp3d_read_vbr_tag(hdr, frame_size, &info->tag_frames);
+        if (info->vbr_tag)
+            return 0;
+    }
+    info->frames++;
+    info->samples += hdr_frame_samples(hdr);
+    info->bitrate_kbps[HDR_GET_BITRATE(hdr)] = frame_info->bitrate_kbps;
+    info->bitrate_frames[HDR_GET_BITRATE(hdr)]++;
+    return 0;
+}
+
+int mp3dec_probe_buf(const uint8_t *buf, size_t buf_size, mp3dec_probe_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    mp3dec_iterate_buf(buf, buf_size, mp3d_probe_frame, info);
+    return info->frames ? 0 : -1;
+}
+
+static int mp3d_count_frame(void *user_data, const uint8_t *hdr, int frame_size, size_t offset, mp3dec_frame_info_t *info)
+{
+    (void)frame_size;
+    (void)offset;
+    /* The tag frame is counted too: it is decoded as silence. */
+    *(size_t *)user_data += hdr_frame_samples(hdr)*info->channels;
+    return 0;
+}
+
+size_t mp3dec_count_samples(const uint8_t *buf, size_t buf_size)
+{
+    size_t samples = 0;
+    mp3dec_iterate_buf(buf, buf_size, mp3d_count_frame, &samples);
+    return samples;
+}
+
+#ifdef MINIMP3_FLOAT_OUTPUT
+void mp3dec_f32_to_s16(const float *in, int16_t *out, size_t num_samples)
+{
+    size_t i;
+    for (i = 0; i < num_samples; i++)
+    {
+        float sample = in[i]*32768.0f;
+        if (sample >=  32766.5)
+            out[i] = (int16_t) 32767;
+        else if (sample <= -32767.5)
+            out[i] = (int16_t)-32768;
+        else
+        {
+            int16_t s = (int16_t)(sample + .5f);
+            s -= (s < 0);   /* away from zero, to be compliant */
+            out[i] = s;
+        }
+    }
+}
+#endif /* MINIMP3_FLOAT_OUTPUT */
+
 int mp3dec_load(mp3dec_t *dec, const char *file_name, mp3dec_file_info_t *info, MP3D_PROGRESS_CB progress_cb, void *user_data)
 {
     int ret;
@@ -0,0 +1,401 @@
+/*************************************************
+ *
+ * Decode the MP3 data.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "mp3.h"
+#include "parallel.h"
+
+
+Mp3Decoder::Mp3Decoder(int blockSamples)
+  : m_blockSamples(blockSamples), m_sampleRate(0), m_channels(0), m_isStarted(false), m_skip(0), m_start(0)
+{
+  mp3dec_init(&m_decoder);
+}
+
+Mp3Decoder::~Mp3Decoder()
+{
+}
+
+void Mp3Decoder::reset()
+{
+  mp3dec_init(&m_decoder);
+  m_sampleRate = 0;
+  m_channels = 0;
+  m_isStarted = false;
+  m_skip = 0;
+  m_pending.clear();
+  m_start = 0;
+  m_block.clear();
+}
+
+void Mp3Decoder::decode(bool isLast, std::vector<float> &pcm)
+{
+  // Skip the ID3v2 tag, as mp3dec_load_buf() does. Its size is known from its first 10 bytes.
+  if (!m_isStarted)
+  {
+    size_t available = m_pending.size() - m_start;
+    if (available <= 10 && !isLast) return;
+    m_skip = mp3dec_skip_id3v2(m_pending.data() + m_start, available);
+    m_isStarted = true;
+  }
+  if (m_skip > 0)
+  {
+    size_t n = std::min(m_skip, m_pending.size() - m_start);
+    m_start += n;
+    m_skip -= n;
+    if (m_skip > 0) return;
+  }
+
+  mp3d_sample_t frame[MINIMP3_MAX_SAMPLES_PER_FRAME];
+  mp3dec_frame_info_t info;
+  while (m_start < m_pending.size() && (isLast || m_pending.size() - m_start >= MP3_STREAM_LOOKAHEAD))
+  {
+    int samples = mp3dec_decode_frame(&m_decoder, m_pending.data() + m_start, m_pending.size() - m_start, frame, &info);
+    if (info.frame_bytes == 0) break;
+    m_start += info.frame_bytes;
+    if (samples == 0) continue;
+
+    if (m_sampleRate == 0) { m_sampleRate = info.hz; m_channels = info.channels; }
+#ifdef MINIMP3_FLOAT_OUTPUT
+    m_block.insert(m_block.end(), frame, frame + samples*info.channels);
+#else
+    for (int i=0; i<samples*info.channels; i++) m_block.push_back(1.0 * ((int) frame[i]) / 32768);
+#endif
+
+    // Emit the whole blocks.
+    size_t blockSize = (m_blockSamples > 0) ? (size_t)m_blockSamples * m_channels : m_block.size();
+    size_t emitted = m_block.size() - m_block.size() % blockSize;
+    pcm.insert(pcm.end(), m_block.begin(), m_block.begin() + emitted);
+    m_block.erase(m_block.begin(), m_block.begin() + emitted);
+  }
+
+  // Drop the decoded bytes once they take more than the lookahead.
+  if (m_start > MP3_STREAM_LOOKAHEAD)
+  {
+    m_pending.erase(m_pending.begin(), m_pending.begin() + m_start);
+    m_start = 0;
+  }
+}
+
+void Mp3Decoder::process(const uint8_t* data, size_t length, std::vector<float> &pcm)
+{
+  // Feed the chunk by pieces, so that the buffer never holds much more than the lookahead.
+  size_t i = 0;
+  while (i < length)
+  {
+    size_t n = std::min(length - i, (size_t)MP3_STREAM_LOOKAHEAD);
+    m_pending.insert(m_pending.end(), data + i, data + i + n);
+    i += n;
+    decode(false, pcm);
+  }
+}
+
+void Mp3Decoder::flush(std::vector<float> &pcm)
+{
+  decode(true, pcm);
+  pcm.insert(pcm.end(), m_block.begin(), m_block.end());
+  m_block.clear();
+}
+
+
+struct Mp3Scan
+{
+  std::vector<Mp3Frame>* frames;
+  mp3dec_frame_info_t* info;
+};
+
+static int addMp3Frame(void* user_data, const uint8_t* frame, int frame_size, size_t offset, mp3dec_frame_info_t* info)
+{
+  Mp3Scan* scan = (Mp3Scan*) user_data;
+  if (scan->frames->empty() && scan->info) *scan->info = *info;
+  scan->frames->push_back({ offset, frame_size, mp3dec_frame_samples(frame) });
+  return 0;
+}
+
+void scanMp3Frames(const uint8_t* data, size_t length, std::vector<Mp3Frame> &frames, mp3dec_frame_info_t* info)
+{
+  frames.clear();
+  if (info) memset(info, 0, sizeof(*info));
+  Mp3Scan scan = { &frames, info };
+  mp3dec_iterate_buf(data, length, addMp3Frame, &scan);
+}
+
+// The first frame to decode before 'first': the main data of the frames before 'first - 1' fill the bit reservoir,
+// and 'first - 1' (and the one before, for the short layer I frames) restores the MDCT overlap and the synthesis filter bank.
+// The warm-up stops at a gap between two frames, where the serial decoder starts over too.
+static size_t getMp3WarmUpStart(const std::vector<Mp3Frame> &frames, size_t first)
+{
+  // At most: the header, the CRC and the side information of a stereo MPEG-1 frame.
+  const int overhead = 4 + 2 + 32;
+  size_t start = first;
+  int mainData = 0;
+  while (start > 0 && frames[start-1].offset + frames[start-1].size == frames[start].offset)
+  {
+    start--;
+    if (start + 1 < first) mainData += std::max(0, frames[start].size - overhead);
+    if (first - start >= 2 && mainData >= MAX_BITRESERVOIR_BYTES) break;
+  }
+  return start;
+}
+
+// Decode the frames [first, last) into 'pcm', which holds 'room' samples, after the frames from 'start' (output dropped).
+// Each frame is decoded from the end of the previous one, as mp3dec_load_buf() does.
+// Returns the samples written, or -1 if the decoder does not find the frames of the scan.
+static long decodeMp3Segment(const uint8_t* data, size_t length, const std::vector<Mp3Frame> &frames,
+                             size_t start, size_t first, size_t last, mp3d_sample_t* pcm, size_t room,
+                             size_t* nbDecoded, size_t* bitrates)
+{
+  // Start as if the frame before had just been decoded: the decoder then only checks the next header,
+  // instead of looking for MAX_FRAME_SYNC_MATCHES frames in a row, which fails before a junk (e.g., a tag between two files).
+  // After a gap, this is the state of the serial decoder once it has resynced.
+  mp3dec_t decoder;
+  memset(&decoder, 0, sizeof(decoder));
+  memcpy(decoder.header, data + frames[start].offset, HDR_SIZE);
+  mp3d_sample_t frame[MINIMP3_MAX_SAMPLES_PER_FRAME];
+  mp3dec_frame_info_t info;
+  size_t position = frames[start].offset;
+  size_t written = 0;
+  for (size_t k=start; k<last; k++)
+  {
+    // The frames are decoded in place while a whole frame fits, as mp3dec_load_buf() does.
+    bool isInPlace = (k >= first && room - written >= MINIMP3_MAX_SAMPLES_PER_FRAME);
+    int mp3Bytes = (int) std::min(length - position, (size_t) 0x7fffffff);
+    int samples = mp3dec_decode_frame(&decoder, data + position, mp3Bytes, isInPlace ? pcm + written : frame, &info);
+    position += info.frame_bytes;
+    if (position != frames[k].offset + frames[k].size) return -1;
+    if (k < first || samples == 0) continue;
+
+    samples *= info.channels;
+    if ((size_t)samples > room - written) return -1;
+    if (!isInPlace) memcpy(pcm + written, frame, samples * sizeof(mp3d_sample_t));
+    written += samples;
+    (*nbDecoded)++;
+    *bitrates += info.bitrate_kbps;
+  }
+  return written;
+}
+
+int decodeMp3Parallel(const uint8_t* data, size_t length, mp3d_sample_t* pcm, size_t maxSamples, int nbThreads, mp3dec_file_info_t* info)
+{
+  mp3dec_frame_info_t first;
+  std::vector<Mp3Frame> frames;
+  scanMp3Frames(data, length, frames, &first);
+  memset(info, 0, sizeof(*info));
+  info->buffer = pcm;
+  if (frames.empty()) return 0;
+
+  // One segment per thread, but not shorter than MP3_DECODE_MIN_SEGMENT frames.
+  if (nbThreads <= 0) nbThreads = getThreadCount();
+  size_t nbSegments = std::max((size_t)1, std::min((size_t)nbThreads, frames.size() / MP3_DECODE_MIN_SEGMENT));
+  std::vector<size_t> firsts(nbSegments + 1), positions(nbSegments + 1, 0);
+  for (size_t c=0; c<=nbSegments; c++) firsts[c] = frames.size() * c / nbSegments;
+  // The position of each segment in 'pcm', if all its frames give samples.
+  for (size_t c=0; c<nbSegments; c++)
+  {
+    positions[c+1] = positions[c];
+    for (size_t k=firsts[c]; k<firsts[c+1]; k++) positions[c+1] += (size_t)frames[k].samples * first.channels;
+  }
+  if (positions[nbSegments] > maxSamples) return -1;
+
+  std::vector<long> written(nbSegments);
+  std::vector<size_t> nbDecoded(nbSegments, 0), bitrates(nbSegments, 0);
+  parallelFor(nbSegments, nbThreads, [&](size_t c) {
+    size_t start = getMp3WarmUpStart(frames, firsts[c]);
+    written[c] = decodeMp3Segment(data, length, frames, start, firsts[c], firsts[c+1],
+                                  pcm + positions[c], positions[c+1] - positions[c], &nbDecoded[c], &bitrates[c]);
+  });
+
+  // The scan and the decoder disagree (a corrupted stream): decode it serially.
+  if (std::find(written.begin(), written.end(), -1) != written.end())
+  {
+    mp3dec_t decoder;
+    return mp3dec_load_buf_into(&decoder, data, length, pcm, maxSamples, info);
+  }
+
+  // Close the gaps left by the frames which gave no samples (e.g., a missing bit reservoir at the start).
+  size_t samples = 0, decoded = 0, bitrate = 0;
+  for (size_t c=0; c<nbSegments; c++)
+  {
+    if (samples != positions[c] && written[c] > 0) memmove(pcm + samples, pcm + positions[c], written[c] * sizeof(mp3d_sample_t));
+    samples += written[c];
+    decoded += nbDecoded[c];
+    bitrate += bitrates[c];
+  }
+  if (decoded == 0) return 0;
+
+  info->samples = samples;
+  info->channels = first.channels;
+  info->hz = first.hz;
+  info->layer = first.layer;
+  info->avg_bitrate_kbps = bitrate / decoded;
+  return 0;
+}
+
+void decodeMp3(const uint8_t* data, size_t length, int nbThreads, mp3dec_file_info_t* info)
+{
+  mp3dec_t decoder;
+  memset(info, 0, sizeof(*info));
+  size_t capacity = mp3dec_count_samples(data, length);
+  if (capacity == 0) return;
+  mp3d_sample_t* pcm = (mp3d_sample_t*) malloc(capacity * sizeof(mp3d_sample_t));
+  if (pcm == NULL) return;
+
+  int ret = (nbThreads == 1) ? mp3dec_load_buf_into(&decoder, data, length, pcm, capacity, info)
+                             : decodeMp3Parallel(data, length, pcm, capacity, nbThreads, info);
+  if (ret < 0)
+  {
+    free(pcm);
+    mp3dec_load_buf(&decoder, data, length, info, 0, 0);
+  }
+  if (info->samples == 0)
+  {
+    free(info->buffer);
+    info->buffer = NULL;
+  }
+}
+
+int buildMp3Index(const uint8_t* data, size_t length, int step, Mp3Index &index)
+{
+  if (step <= 0 || length > UINT32_MAX) return -1;
+
+  mp3dec_frame_info_t info;
+  std::vector<Mp3Frame> frames;
+  scanMp3Frames(data, length, frames, &info);
+  if (frames.empty()) return -1;
+
+  index.size = length;
+  index.step = step;
+  index.nbFrames = frames.size();
+  index.frameSamples = frames[0].samples;
+  index.sampleRate = info.hz;
+  index.channels = info.channels;
+  index.offsets.clear();
+  for (size_t k=0; k<frames.size(); k+=step) index.offsets.push_back(frames[k].offset);
+
+  return 0;
+}
+
+struct Mp3Walk
+{
+  std::vector<Mp3Frame>* frames;
+  size_t count;
+};
+
+static int addMp3WalkFrame(void* user_data, const uint8_t* frame, int frame_size, size_t offset, mp3dec_frame_info_t* info)
+{
+  Mp3Walk* walk = (Mp3Walk*) user_data;
+  walk->frames->push_back({ offset, frame_size, mp3dec_frame_samples(frame) });
+  return (walk->frames->size() >= walk->count) ? 1 : 0;
+}
+
+int mp3DecodeRange(const uint8_t* data, size_t length, const Mp3Index &index, double startMs, double endMs, int preRoll, std::vector<mp3d_sample_t> &pcm)
+{
+  pcm.clear();
+  if ( index.size != length || index.step <= 0 || index.frameSamples <= 0 || index.channels <= 0 ) return -1;
+  if ( (int)index.offsets.size() != (index.nbFrames > 0 ? (index.nbFrames - 1) / index.step + 1 : 0) ) return -1;
+
+  long long totalSamples = (long long) index.nbFrames * index.frameSamples;
+  long long startSample = (startMs > 0) ? (long long)(startMs * index.sampleRate / 1000) : 0;
+  long long endSample = std::min((long long)(endMs * index.sampleRate / 1000), totalSamples);
+  if ( startSample >= endSample ) return 0;
+
+  // The frames covering the range, and the indexed frame to walk the headers from.
+  int first = startSample / index.frameSamples;
+  int last = (endSample + index.frameSamples - 1) / index.frameSamples;
+  int frame = std::max(0, first - std::max(0, preRoll));
+  frame -= frame % index.step;
+
+  std::vector<Mp3Frame> frames;
+  Mp3Walk walk = { &frames, (size_t)(last - frame) };
+  mp3dec_iterate_buf_from(data, length, index.offsets[frame / index.step], addMp3WalkFrame, &walk);
+  if ( (int)frames.size() <= first - frame ) return -1;
+
+  // The frames which give no samples (e.g., a corrupted frame) leave silence at the end.
+  size_t channels = index.channels;
+  pcm.assign((size_t)(last - first) * index.frameSamples * channels, 0);
+  size_t start = getMp3WarmUpStart(frames, first - frame);
+  size_t nbDecoded = 0, bitrates = 0;
+  long written = decodeMp3Segment(data, length, frames, start, first - frame, frames.size(), pcm.data(), pcm.size(), &nbDecoded, &bitrates);
+  if ( written < 0 ) { pcm.clear(); return -1; }
+
+  // Drop the samples of the first frame before the start.
+  size_t head = (size_t)(startSample - (long long) first * index.frameSamples) * channels;
+  pcm.erase(pcm.begin(), pcm.begin() + head);
+  pcm.resize((size_t)(endSample - startSample) * channels);
+
+  return 0;
+}
+
+static void writeUint32(char* data, uint32_t value)
+{
+  for (int i=0; i<4; i++) data[i] = (value >> (8*i)) & 0xff;
+}
+
+static uint32_t readUint32(const char* data)
+{
+  uint32_t value = 0;
+  for (int i=0; i<4; i++) value |= ((uint32_t)(uint8_t)data[i]) << (8*i);
+  return value;
+}
+
+// "MP3I", version, step, nbFrames, size, frameSamples, sampleRate, channels, then the offsets. All are 32-bit.
+#define MP3_INDEX_MAGIC       "MP3I"
+#define MP3_INDEX_VERSION     (1)
+#define MP3_INDEX_HEADER_SIZE (32)
+
+char* serializeMp3Index(const Mp3Index &index, int* out_size)
+{
+  *out_size = MP3_INDEX_HEADER_SIZE + 4 * index.offsets.size();
+  char* result = (char*) malloc(*out_size);
+
+  memcpy(result, MP3_INDEX_MAGIC, 4);
+  writeUint32(result + 4, MP3_INDEX_VERSION);
+  writeUint32(result + 8, index.step);
+  writeUint32(result + 12, index.nbFrames);
+  writeUint32(result + 16, index.size);
+  writeUint32(result + 20, index.frameSamples);
+  writeUint32(result + 24, index.sampleRate);
+  writeUint32(result + 28, index.channels);
+  for (size_t i=0; i<index.offsets.size(); i++) writeUint32(result + MP3_INDEX_HEADER_SIZE + 4*i, index.offsets[i]);
+
+  return result;
+}
+
+int deserializeMp3Index(const char* data, int size, Mp3Index &index)
+{
+  if ( size < MP3_INDEX_HEADER_SIZE || 0 != memcmp(data, MP3_INDEX_MAGIC, 4) ) return -1;
+  if ( readUint32(data + 4) != MP3_INDEX_VERSION ) return -1;
+
+  index.step = readUint32(data + 8);
+  index.nbFrames = readUint32(data + 12);
+  index.size = readUint32(data + 16);
+  index.frameSamples = readUint32(data + 20);
+  index.sampleRate = readUint32(data + 24);
+  index.channels = readUint32(data + 28);
+  if ( index.step <= 0 || index.nbFrames < 0 ) return -1;
+  if ( index.frameSamples <= 0 || index.frameSamples > MINIMP3_MAX_SAMPLES_PER_FRAME / 2 ) return -1;
+  if ( index.sampleRate <= 0 || (index.channels != 1 && index.channels != 2) ) return -1;
+
+  int nbOffsets = (index.nbFrames > 0) ? (index.nbFrames - 1) / index.step + 1 : 0;
+  if ( size != MP3_INDEX_HEADER_SIZE + 4 * nbOffsets ) return -1;
+  index.offsets.resize(nbOffsets);
+  for (int i=0; i<nbOffsets; i++)
+  {
+    index.offsets[i] = readUint32(data + MP3_INDEX_HEADER_SIZE + 4*i);
+    if ( index.offsets[i] >= index.size ) return -1;
+  }
+
+  return 0;
+}
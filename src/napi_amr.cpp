@@ -10,9 +10,12 @@
  *
  ************************************************/
 
+#include <math.h>
+#include <string.h>
 #include <vector>
 
 #include "amr.h"
+#include "parallel.h"
 
 #include "napi_amr.h"
 #include "napi_common.h"
@@ -105,12 +108,188 @@ napi_value amr2pcm(napi_env env, napi_callback_info args)
 }
 
 
-// Encode the PCM data to the AMR/NB/WB data.
-// arg[0]: pcmdata  (float32array)
-// arg[1]: sample rate
-// arg[2]: mode: (0: 4.75k, 1: 5.15k, 2: 5.90k, 3: 6.70k, 4: 7.40k, 5: 7.95k, 6: 10.2k, 7: 12.2k)
-// return: arg[0]: amrdata  (uint8array)
-napi_value pcm2amr(napi_env env, napi_callback_info args)
+// Decode the AMR buffers on a worker thread, each buffer on one of the native threads.
+class AmrBatchTask : public AsyncTask
+{
+
+public:
+
+  virtual ~AmrBatchTask() { free(m_pcm); };
+
+  virtual void execute()
+  {
+    size_t count = m_buffers.size();
+    m_offsets.resize(count + 1);
+    m_sampleRates.resize(count);
+    short* pcm = amr2pcmBatch(m_buffers.data(), m_sizes.data(), count, m_offsets.data(), m_sampleRates.data(), m_nbThreads);
+    if (pcm == NULL) { m_error = "Failed to allocate the PCM buffer."; return; }
+    size_t samples = m_offsets[count];
+    if (samples > UINT32_MAX) { free(pcm); m_error = "Too many samples in one batch."; return; }
+
+    m_pcm = (float*) malloc((samples > 0 ? samples : 1)*sizeof(float));
+    if (m_pcm == NULL) { free(pcm); m_error = "Failed to allocate the PCM buffer."; return; }
+    parallelFor(count, m_nbThreads, [&](size_t i) {
+      for (size_t j=m_offsets[i]; j<m_offsets[i+1]; j++) m_pcm[j] = 1.0 * ((int) pcm[j]) / 32768;
+    });
+    free(pcm);
+  };
+
+  virtual napi_value complete(napi_env env);
+
+  // Input: the buffers point into the JS arrays, kept alive by keep().
+  std::vector<char*> m_buffers;
+  std::vector<int> m_sizes;
+  int32_t m_nbThreads = 0;
+  bool m_isSeparate = false;
+
+private:
+
+  float* m_pcm = NULL;
+  std::vector<size_t> m_offsets;
+  std::vector<int> m_sampleRates;
+};
+
+napi_value AmrBatchTask::complete(napi_env env)
+{
+  napi_value result;
+  napi_status status;
+
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  uint32_t count = m_buffers.size();
+  size_t samples = m_offsets[count];
+
+  // Set the return value.
+  // -- First, hand the PCM buffer over to the ArrayBuffer, shared by all the buffers.
+  napi_value arraybuffer = createArrayBufferFrom(env, m_pcm, samples*sizeof(float));
+  m_pcm = NULL;
+  if (arraybuffer == nullptr) return nullptr;
+
+  // -- Second, create the TypedArrays.
+  napi_value pcmvalue;
+  if (m_isSeparate)
+  {
+    status = napi_create_array_with_length(env, count, &pcmvalue);
+    if (status != napi_ok) return nullptr;
+    for (uint32_t i=0; i<count; i++)
+    {
+      napi_value pcmarray;
+      status = napi_create_typedarray(env, napi_float32_array, m_offsets[i+1] - m_offsets[i], arraybuffer, m_offsets[i]*sizeof(float), &pcmarray);
+      if (status != napi_ok) return nullptr;
+      status = napi_set_element(env, pcmvalue, i, pcmarray);
+      if (status != napi_ok) return nullptr;
+    }
+  }
+  else
+  {
+    status = napi_create_typedarray(env, napi_float32_array, samples, arraybuffer, 0, &pcmvalue);
+    if (status != napi_ok) return nullptr;
+
+    napi_value offsetbuffer;
+    uint32_t* offsetdata = NULL;
+    status = napi_create_arraybuffer(env, (count + 1)*sizeof(uint32_t), (void**)&offsetdata, &offsetbuffer);
+    if (status != napi_ok) return nullptr;
+    for (uint32_t i=0; i<=count; i++) offsetdata[i] = m_offsets[i];
+    napi_value offsetarray;
+    status = napi_create_typedarray(env, napi_uint32_array, count + 1, offsetbuffer, 0, &offsetarray);
+    if (status != napi_ok) return nullptr;
+    status = napi_set_named_property(env, result, "offsets", offsetarray);
+    if (status != napi_ok) return nullptr;
+  }
+
+  // Set the sample rates.
+  napi_value ratebuffer;
+  int32_t* ratedata = NULL;
+  status = napi_create_arraybuffer(env, count*sizeof(int32_t), (void**)&ratedata, &ratebuffer);
+  if (status != napi_ok) return nullptr;
+  for (uint32_t i=0; i<count; i++) ratedata[i] = m_sampleRates[i];
+  napi_value samplerates;
+  status = napi_create_typedarray(env, napi_int32_array, count, ratebuffer, 0, &samplerates);
+  if (status != napi_ok) return nullptr;
+
+  // Set the bitdepth
+  napi_value bitdepth;
+  status = napi_create_int32(env, 16, &bitdepth);
+  if (status != napi_ok) return nullptr;
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "pcm", pcmvalue);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "samplerates", samplerates);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "bitdepth", bitdepth);
+  if (status != napi_ok) return nullptr;
+
+  return result;
+}
+
+// Decode many AMR/NB/WB buffers in parallel, on a worker thread.
+// arg[0]: amrdata  (array of uint8array or buffer, which must not be changed until the promise is settled)
+// arg[1]: options (optional) { threads: one per core by default, separate: false }
+// return: { pcm, offsets, samplerates, bitdepth }
+//         pcm: all the samples back to back (float32array), or an array of float32array if 'separate'.
+//         offsets: the start of each buffer in 'pcm' and the total length (uint32array, not set if 'separate').
+//         samplerates: 8000, 16000, or 0 if the buffer is not AMR (int32array).
+napi_value amr2pcmBatch(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  // Parse the input arguments.
+  size_t argc = 2;
+  napi_value argv[2];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the options.
+  napi_value options = (argc > 1) ? argv[1] : NULL;
+  int32_t nbThreads = 0;
+  bool isSeparate = false;
+  if (!getOptionInt32(env, options, "threads", &nbThreads)) { throwException(env, "The threads option must be a number."); return nullptr; }
+  if (!getOptionBool(env, options, "separate", &isSeparate)) { throwException(env, "The separate option must be a boolean."); return nullptr; }
+
+  // -- Get the data buffers. They are only pointed to, and kept alive until the promise is settled.
+  uint32_t count = 0;
+  status = napi_get_array_length(env, argv[0], &count);
+  if (status != napi_ok) { throwException(env, "The AMR data must be an array."); return nullptr; }
+
+  std::vector<char*> buffers(count);
+  std::vector<int> sizes(count);
+  std::vector<napi_value> values(count);
+  for (uint32_t i=0; i<count; i++)
+  {
+    status = napi_get_element(env, argv[0], i, &values[i]);
+    if (status != napi_ok) { throwException(env, "Failed to get the AMR data buffer."); return nullptr; }
+
+    uint8_t* dataptr;
+    napi_typedarray_type type;
+    size_t length;
+    napi_value arraybuffer;
+    size_t byte_offset;
+    status = napi_get_typedarray_info(env, values[i], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+    if (status != napi_ok || type != napi_uint8_array) { throwException(env, "Each AMR data must be a Uint8Array or a Buffer."); return nullptr; }
+    buffers[i] = (char*)dataptr;
+    sizes[i] = length;
+  }
+
+  // Decode the AMR data, on a worker thread.
+  AmrBatchTask* task = new AmrBatchTask();
+  task->m_buffers = buffers;
+  task->m_sizes = sizes;
+  task->m_nbThreads = nbThreads;
+  task->m_isSeparate = isSeparate;
+  for (uint32_t i=0; i<count; i++) task->keep(env, values[i]);
+
+  return queueAsyncTask(env, "amr2pcmBatch", task);
+}
+
+// Build the seek index of the AMR/NB/WB data, by walking the frame headers only.
+// arg[0]: amrdata  (uint8array or buffer)
+// arg[1]: step (optional, 1 by default): index every 'step'-th frame
+// return: { index, frames, duration, samplerate }
+//         index: the serialized index (buffer), which could be cached next to the file.
+//         duration: in ms.
+napi_value amrIndex(napi_env env, napi_callback_info args)
 {
   napi_value result;
   napi_deferred deferred;
@@ -127,54 +306,60 @@ napi_value pcm2amr(napi_env env, napi_callback_info args)
   if (status != napi_ok) return nullptr;
 
   // Parse the input arguments.
-  size_t argc = 3;
-  napi_value argv[3];
+  size_t argc = 2;
+  napi_value argv[2];
   status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
 
   // -- Get the data buffer.
-  // -- Get the wave data buffer. (Only accepts one channel).
-  float* data;
+  uint8_t* dataptr;
   napi_typedarray_type type;
   size_t length;
   napi_value arraybuffer;
   size_t byte_offset;
-  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
-  if (status != napi_ok) return nullptr;
-  // -- Save the wave data buffer. (Only accepts one channel).
-  short* pcmData = new short[length]; // We only use the first channel or at most the first two channels.
-  for (size_t i=0; i<length; i++) pcmData[i] = data[i]*32768;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok) { throwException(env, "Failed to get the AMR data buffer."); return nullptr; }
 
-  // -- Get the sample rate.
-  int32_t sampleRate;
-  status = napi_get_value_int32(env, argv[1], &sampleRate);
-  if (status != napi_ok) return nullptr;
+  // -- Get the step.
+  int32_t step = 1;
+  if (argc > 1)
+  {
+    status = napi_get_value_int32(env, argv[1], &step);
+    if (status != napi_ok || step <= 0) { throwException(env, "The step must be a positive number."); return nullptr; }
+  }
 
-  // -- Get the AMR rate mode.
-  int32_t mode;
-  status = napi_get_value_int32(env, argv[2], &mode);
-  if (status != napi_ok) return nullptr;
+  // Build the index.
+  AmrIndex index;
+  if (buildAMRIndex((char*)dataptr, length, step, index) < 0) { throwException(env, "Invalid AMR data."); return nullptr; }
 
-  // Convert PCM data
-  int byte_length = 0;
-  char* amr = pcm2amr(pcmData, length, sampleRate, &byte_length, mode);
-  if (amr == NULL) return nullptr;
-  delete []pcmData;
+  // Set the return value as Buffer.
+  int szIndex = 0;
+  char* serialized = serializeAMRIndex(index, &szIndex);
+  napi_value buffer;
+  char* indexdata = NULL;
+  status = napi_create_buffer(env, szIndex, (void**)&indexdata, &buffer);
+  if (status != napi_ok) { free(serialized); return nullptr; }
+  memcpy(indexdata, serialized, szIndex);
+  free(serialized);
 
-  // Set the return value.
-  byte_offset = 0;
-  // -- First, create the ArrayBuffer.
-  uint8_t* amrdata = NULL;
-  status = napi_create_arraybuffer(env, byte_length, (void**)&amrdata, &arraybuffer);
+  napi_value frames;
+  status = napi_create_int32(env, index.nbFrames, &frames);
   if (status != napi_ok) return nullptr;
-  for (size_t i=0; i<(size_t)byte_length; i++) amrdata[i] = amr[i];
-  delete [] amr;
-  // -- Second, create the TypedArray.
-  napi_value amrarray;
-  status = napi_create_typedarray(env, napi_uint8_array, byte_length, arraybuffer, byte_offset, &amrarray);
+  napi_value duration;
+  status = napi_create_double(env, 1.0 * index.nbFrames * AMR_FRAME_MS, &duration);
+  if (status != napi_ok) return nullptr;
+  napi_value samplerate;
+  status = napi_create_int32(env, (index.type==AMR_NB) ? 8000 : 16000, &samplerate);
   if (status != napi_ok) return nullptr;
 
   // Set the named property.
-  status = napi_set_named_property(env, result, "data", amrarray);
+  status = napi_set_named_property(env, result, "index", buffer);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "frames", frames);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "duration", duration);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "samplerate", samplerate);
   if (status != napi_ok) return nullptr;
 
   status = napi_resolve_deferred(env, deferred, result);
@@ -186,11 +371,14 @@ napi_value pcm2amr(napi_env env, napi_callback_info args)
   return promise;
 }
 
-// Encode the PCM data from the WAVE buffer to the AMR/NB/WB data.
-// arg[0]: wavbuffer  (buffer)
-// arg[1]: mode: (0: 4.75k, 1: 5.15k, 2: 5.90k, 3: 6.70k, 4: 7.40k, 5: 7.95k, 6: 10.2k, 7: 12.2k)
-// return: arg[0]: amrdata  (uint8array)
-napi_value wav2amr(napi_env env, napi_callback_info args)
+// Decode a time range of the AMR/NB/WB data.
+// arg[0]: amrdata  (uint8array or buffer)
+// arg[1]: start (ms)
+// arg[2]: end (ms)
+// arg[3]: options (optional) { index: the buffer from amrIndex(), preRoll: 25 (frames) }
+//         Without the index, the frame headers are walked from the beginning.
+// return: { pcm, samplerate, bitdepth }
+napi_value amrDecodeRange(napi_env env, napi_callback_info args)
 {
   napi_value result;
   napi_deferred deferred;
@@ -207,34 +395,226 @@ napi_value wav2amr(napi_env env, napi_callback_info args)
   if (status != napi_ok) return nullptr;
 
   // Parse the input arguments.
-  size_t argc = 2;
-  napi_value argv[2];
+  size_t argc = 4;
+  napi_value argv[4];
   status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
 
   // -- Get the data buffer.
-  void* data;
+  uint8_t* dataptr;
+  napi_typedarray_type type;
   size_t length;
-  status = napi_get_buffer_info(env, argv[0], &data, &length);
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok) { throwException(env, "Failed to get the AMR data buffer."); return nullptr; }
+
+  // -- Get the range.
+  double startMs, endMs;
+  status = napi_get_value_double(env, argv[1], &startMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the start time."); return nullptr; }
+  status = napi_get_value_double(env, argv[2], &endMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the end time."); return nullptr; }
+
+  // -- Get the options.
+  napi_value options = (argc > 3) ? argv[3] : NULL;
+  int32_t preRoll = AMR_PRE_ROLL;
+  if (!getOptionInt32(env, options, "preRoll", &preRoll) || preRoll < 0) { throwException(env, "The preRoll option must be a non-negative number."); return nullptr; }
+
+  AmrIndex index;
+  bool hasIndex = false;
+  napi_valuetype valuetype = napi_undefined;
+  if (options != NULL && napi_typeof(env, options, &valuetype) == napi_ok && valuetype == napi_object &&
+      napi_has_named_property(env, options, "index", &hasIndex) == napi_ok && hasIndex)
+  {
+    napi_value indexvalue;
+    status = napi_get_named_property(env, options, "index", &indexvalue);
+    if (status != napi_ok) { throwException(env, "Failed to get the index."); return nullptr; }
+
+    void* indexdata;
+    size_t szIndex;
+    status = napi_get_buffer_info(env, indexvalue, &indexdata, &szIndex);
+    if (status != napi_ok) { throwException(env, "The index must be a buffer."); return nullptr; }
+    if (deserializeAMRIndex((char*)indexdata, szIndex, index) < 0 || index.size != (int)length) { throwException(env, "The index does not match the AMR data."); return nullptr; }
+  }
+  else
+  {
+    if (buildAMRIndex((char*)dataptr, length, AMR_INDEX_STEP, index) < 0) { throwException(env, "Invalid AMR data."); return nullptr; }
+  }
+
+  // Decode the range.
+  int samples = 0;
+  short* pcm = amrDecodeRange((char*)dataptr, length, index, startMs, endMs, preRoll, &samples);
+
+  // Set the return value.
+  size_t byte_length = samples*sizeof(float);
+  // -- First, create the ArrayBuffer.
+  float* pcmdata = NULL;
+  status = napi_create_arraybuffer(env, byte_length, (void**)&pcmdata, &arraybuffer);
+  if (status != napi_ok) { free(pcm); return nullptr; }
+  for (int i=0; i<samples; i++) pcmdata[i] = 1.0 * ((int) pcm[i]) / 32768;
+  free(pcm);
+  // -- Second, create the TypedArray.
+  napi_value pcmarray;
+  status = napi_create_typedarray(env, napi_float32_array, samples, arraybuffer, 0, &pcmarray);
+  if (status != napi_ok) return nullptr;
+
+  napi_value samplerate;
+  status = napi_create_int32(env, (index.type==AMR_NB) ? 8000 : 16000, &samplerate);
+  if (status != napi_ok) return nullptr;
+  napi_value bitdepth;
+  status = napi_create_int32(env, 16, &bitdepth);
+  if (status != napi_ok) return nullptr;
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "pcm", pcmarray);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "bitdepth", bitdepth);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "samplerate", samplerate);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Encode the chunks of the PCM data in parallel, on a worker thread.
+class AmrEncodeTask : public AsyncTask
+{
+
+public:
+
+  virtual ~AmrEncodeTask() { delete [] m_pcm; free(m_amr); }; // m_amr is allocated by malloc().
+
+  virtual void execute()
+  {
+    m_amr = pcm2amrParallel(m_pcm, m_length, m_sampleRate, &m_size, m_mode, m_dtx, m_nbThreads);
+    if (m_amr == NULL) m_error = "Failed to encode the PCM data.";
+  };
+
+  // Create the resulting object { data }.
+  virtual napi_value complete(napi_env env)
+  {
+    napi_value result;
+    napi_status status = napi_create_object(env, &result);
+    if (status != napi_ok) return nullptr;
+
+    uint8_t* amrdata = NULL;
+    napi_value arraybuffer;
+    status = napi_create_arraybuffer(env, m_size, (void**)&amrdata, &arraybuffer);
+    if (status != napi_ok) return nullptr;
+    memcpy(amrdata, m_amr, m_size);
+    napi_value amrarray;
+    status = napi_create_typedarray(env, napi_uint8_array, m_size, arraybuffer, 0, &amrarray);
+    if (status != napi_ok) return nullptr;
+
+    status = napi_set_named_property(env, result, "data", amrarray);
+    if (status != napi_ok) return nullptr;
+
+    return result;
+  };
+
+  // Input: a copy of the samples, as 16-bit.
+  short* m_pcm = NULL;
+  size_t m_length = 0;
+  int32_t m_sampleRate;
+  int32_t m_mode;
+  bool m_dtx = false;
+  int32_t m_nbThreads;
+
+private:
+
+  char* m_amr = NULL;
+  int m_size = 0;
+};
+
+// Encode the PCM data to the AMR/NB/WB data.
+// arg[0]: pcmdata  (float32array)
+// arg[1]: sample rate
+// arg[2]: mode: (0: 4.75k, 1: 5.15k, 2: 5.90k, 3: 6.70k, 4: 7.40k, 5: 7.95k, 6: 10.2k, 7: 12.2k)
+// arg[3]: dtx (optional, false by default): the silence is sent as the SID and NO_DATA frames.
+// arg[4]: threads (optional, 1 by default): encode the chunks of a long recording in parallel (0: one per core).
+// return: arg[0]: amrdata  (uint8array)
+napi_value pcm2amr(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Parse the input arguments.
+  size_t argc = 5;
+  napi_value argv[5];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+
+  // -- Get the data buffer.
+  // -- Get the wave data buffer. (Only accepts one channel).
+  float* data;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+  if (status != napi_ok) return nullptr;
+
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[1], &sampleRate);
   if (status != napi_ok) return nullptr;
-  // -- Save the wave data buffer. (Only accepts one channel).
-  char* wavData = new char[length];
-  memcpy(wavData, data, length);
 
   // -- Get the AMR rate mode.
   int32_t mode;
-  status = napi_get_value_int32(env, argv[1], &mode);
+  status = napi_get_value_int32(env, argv[2], &mode);
+  if (status != napi_ok) return nullptr;
+
+  // -- Get the DTX flag.
+  bool dtx = false;
+  if (argc > 3 && napi_get_value_bool(env, argv[3], &dtx) != napi_ok) { throwException(env, "The DTX flag should be a boolean."); return nullptr; }
+
+  // -- Get the number of threads.
+  int32_t nbThreads = 1;
+  if (argc > 4 && (napi_get_value_int32(env, argv[4], &nbThreads) != napi_ok || nbThreads < 0)) { throwException(env, "The number of threads should be a non-negative integer."); return nullptr; }
+
+  // -- Save the wave data buffer, once all the arguments are valid. (Only accepts one channel).
+  short* pcmData = new short[length]; // We only use the first channel or at most the first two channels.
+  for (size_t i=0; i<length; i++) pcmData[i] = data[i]*32768;
+
+  // Encode the chunks in parallel, on a worker thread.
+  if (nbThreads != 1)
+  {
+    AmrEncodeTask* task = new AmrEncodeTask();
+    task->m_pcm = pcmData;
+    task->m_length = length;
+    task->m_sampleRate = sampleRate;
+    task->m_mode = mode;
+    task->m_dtx = dtx;
+    task->m_nbThreads = nbThreads;
+    return queueAsyncTask(env, "pcm2amr", task);
+  }
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
   if (status != napi_ok) return nullptr;
 
   // Convert PCM data
   int byte_length = 0;
-  char* amr = wav2amr(wavData, length, &byte_length, mode);
-  if (amr == NULL) return nullptr;
-  delete []wavData;
+  char* amr = pcm2amr(pcmData, length, sampleRate, &byte_length, mode, dtx);
+  delete []pcmData;
+  if (amr == NULL) { throwException(env, "Failed to encode the AMR data."); return nullptr; }
 
   // Set the return value.
-  size_t byte_offset = 0;
+  byte_offset = 0;
   // -- First, create the ArrayBuffer.
-  napi_value arraybuffer;
   uint8_t* amrdata = NULL;
   status = napi_create_arraybuffer(env, byte_length, (void**)&amrdata, &arraybuffer);
   if (status != napi_ok) return nullptr;
@@ -258,15 +638,12 @@ napi_value wav2amr(napi_env env, napi_callback_info args)
   return promise;
 }
 
-//napi_value mp32amr(napi_env env, napi_callback_info args)
-//{
-//}
-
-// Remove the silence frames from both the beginning and end in the AMR/NB/WB data.
-// arg[0]: amrdata  (uint8array)
-// arg[1]: threshold (float)
-// return: amrdata  (uint8array)
-napi_value amr_remove_silence(napi_env env, napi_callback_info args)
+// Encode the PCM data to the AMR-WB data.
+// arg[0]: pcmdata  (float32array)
+// arg[1]: sample rate (resampled to 16000 if needed)
+// arg[2]: mode: (0: 6.60k, 1: 8.85k, 2: 12.65k, 3: 14.25k, 4: 15.85k, 5: 18.25k, 6: 19.85k, 7: 23.05k, 8: 23.85k)
+// return: arg[0]: amrdata  (uint8array)
+napi_value pcm2amrwb(napi_env env, napi_callback_info args)
 {
   napi_value result;
   napi_deferred deferred;
@@ -274,6 +651,8 @@ napi_value amr_remove_silence(napi_env env, napi_callback_info args)
 
   napi_status status;
 
+  if (!hasAMRWBEncoder()) { throwException(env, "AMR-WB encoding is not available in this build."); return nullptr; }
+
   // Create the promise.
   status = napi_create_promise(env, &deferred, &promise);
   if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
@@ -283,29 +662,181 @@ napi_value amr_remove_silence(napi_env env, napi_callback_info args)
   if (status != napi_ok) return nullptr;
 
   // Parse the input arguments.
-  size_t argc = 2;
-  napi_value argv[2];
+  size_t argc = 3;
+  napi_value argv[3];
   status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok || argc < 3) { throwException(env, "Expect three arguments: pcmdata, samplerate and mode."); return nullptr; }
 
-  // -- Get the data buffer.
-  uint8_t* dataptr;
+  // -- Get the wave data buffer. (Only accepts one channel).
+  float* data;
   napi_typedarray_type type;
   size_t length;
   napi_value arraybuffer;
   size_t byte_offset;
-  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
-  if (status != napi_ok) return nullptr;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_float32_array) { throwException(env, "The PCM data should be a Float32Array."); return nullptr; }
 
-  // -- Get the threshold.
-  double threshold;
-  status = napi_get_value_double(env, argv[1], &threshold);
-  if (status != napi_ok) threshold = 0.1; // the default value
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[1], &sampleRate);
+  if (status != napi_ok || sampleRate <= 0) { throwException(env, "The sample rate should be a positive integer."); return nullptr; }
 
-  // Remove the silent frames from the AMR data.
-  char* pOutput = NULL;
-  int szOutput = 0;
-  amr_remove_silence((char*)dataptr, length, (float)threshold, &pOutput, &szOutput);
-  if (szOutput == 0) return nullptr;
+  // -- Get the AMR-WB rate mode.
+  int32_t mode;
+  status = napi_get_value_int32(env, argv[2], &mode);
+  if (status != napi_ok || mode < 0 || mode > 8) { throwException(env, "The AMR-WB mode should be within [0, 8]."); return nullptr; }
+
+  std::vector<short> pcmData(length);
+  for (size_t i=0; i<length; i++) pcmData[i] = fmax(-32768, fmin(32767, data[i]*32768));
+
+  // Encode the PCM data.
+  int byte_length = 0;
+  char* amr = pcm2amrwb(pcmData.data(), length, sampleRate, &byte_length, mode);
+  if (amr == NULL) { throwException(env, "Failed to encode the AMR-WB data."); return nullptr; }
+
+  napi_value amrarray;
+  status = napi_create_buffer_copy(env, byte_length, amr, NULL, &amrarray);
+  free(amr);
+  if (status != napi_ok) { throwException(env, "Failed to create the AMR buffer."); return nullptr; }
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "data", amrarray);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Encode the PCM data from the WAVE buffer to the AMR/NB/WB data.
+// arg[0]: wavbuffer  (buffer)
+// arg[1]: mode: (0: 4.75k, 1: 5.15k, 2: 5.90k, 3: 6.70k, 4: 7.40k, 5: 7.95k, 6: 10.2k, 7: 12.2k)
+// arg[2]: dtx (optional, false by default): the silence is sent as the SID and NO_DATA frames.
+// return: arg[0]: amrdata  (uint8array)
+napi_value wav2amr(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  // Parse the input arguments.
+  size_t argc = 3;
+  napi_value argv[3];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+
+  // -- Get the data buffer.
+  void* data;
+  size_t length;
+  status = napi_get_buffer_info(env, argv[0], &data, &length);
+  if (status != napi_ok) return nullptr;
+  // -- Save the wave data buffer. (Only accepts one channel).
+  char* wavData = new char[length];
+  memcpy(wavData, data, length);
+
+  // -- Get the AMR rate mode.
+  int32_t mode;
+  status = napi_get_value_int32(env, argv[1], &mode);
+  if (status != napi_ok) return nullptr;
+
+  // -- Get the DTX flag.
+  bool dtx = false;
+  if (argc > 2 && napi_get_value_bool(env, argv[2], &dtx) != napi_ok) { throwException(env, "The DTX flag should be a boolean."); return nullptr; }
+
+  // Convert PCM data
+  int byte_length = 0;
+  char* amr = wav2amr(wavData, length, &byte_length, mode, dtx);
+  if (amr == NULL) return nullptr;
+  delete []wavData;
+
+  // Set the return value.
+  size_t byte_offset = 0;
+  // -- First, create the ArrayBuffer.
+  napi_value arraybuffer;
+  uint8_t* amrdata = NULL;
+  status = napi_create_arraybuffer(env, byte_length, (void**)&amrdata, &arraybuffer);
+  if (status != napi_ok) return nullptr;
+  for (size_t i=0; i<(size_t)byte_length; i++) amrdata[i] = amr[i];
+  delete [] amr;
+  // -- Second, create the TypedArray.
+  napi_value amrarray;
+  status = napi_create_typedarray(env, napi_uint8_array, byte_length, arraybuffer, byte_offset, &amrarray);
+  if (status != napi_ok) return nullptr;
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "data", amrarray);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+//napi_value mp32amr(napi_env env, napi_callback_info args)
+//{
+//}
+
+// Remove the silence frames from both the beginning and end in the AMR/NB/WB data.
+// arg[0]: amrdata  (uint8array)
+// arg[1]: threshold (float)
+// return: amrdata  (uint8array)
+napi_value amr_remove_silence(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  // Parse the input arguments.
+  size_t argc = 2;
+  napi_value argv[2];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+
+  // -- Get the data buffer.
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok) return nullptr;
+
+  // -- Get the threshold.
+  double threshold;
+  status = napi_get_value_double(env, argv[1], &threshold);
+  if (status != napi_ok) threshold = 0.1; // the default value
+
+  // Remove the silent frames from the AMR data.
+  char* pOutput = NULL;
+  int szOutput = 0;
+  amr_remove_silence((char*)dataptr, length, (float)threshold, &pOutput, &szOutput);
+  if (szOutput == 0) return nullptr;
 
   // Set the return value as Buffer.
   napi_value buffer;
@@ -329,3 +860,629 @@ napi_value amr_remove_silence(napi_env env, napi_callback_info args)
 
   return promise;
 }
+
+
+// Write the selected frames into a new Buffer, the only allocation of the edit, and resolve { data } with it.
+static napi_value resolveAMRFrames(napi_env env, napi_deferred deferred, napi_value promise, const std::vector<AmrFrames> &frames)
+{
+  napi_status status;
+
+  int size = writeAMRFrames(frames, NULL);
+  if (size < 0) { throwException(env, "The AMR data must be all AMR-NB or all AMR-WB."); return nullptr; }
+
+  napi_value buffer;
+  char* amrdata = NULL;
+  status = napi_create_buffer(env, size, (void**)&amrdata, &buffer);
+  if (status != napi_ok) { throwException(env, "Failed to create the AMR buffer."); return nullptr; }
+  writeAMRFrames(frames, amrdata);
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "data", buffer);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  return promise;
+}
+
+// Get the AMR data buffer and select its frames within [startMs, endMs).
+static bool getAMRFrames(napi_env env, napi_value value, double startMs, double endMs, AmrFrames &frames)
+{
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, value, &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_uint8_array) { throwException(env, "Failed to get the AMR data buffer."); return false; }
+
+  if (selectAMRFrames((char*)dataptr, length, startMs, endMs, frames) < 0) { throwException(env, "Invalid AMR data."); return false; }
+
+  return true;
+}
+
+// Concatenate the AMR/NB/WB data, frame by frame, without transcoding.
+// arg[0]: amrdata  (array of uint8array or buffer, all AMR-NB or all AMR-WB)
+// return: amrdata  (buffer)
+napi_value amrConcat(napi_env env, napi_callback_info args)
+{
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 1;
+  napi_value argv[1];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  uint32_t count = 0;
+  status = napi_get_array_length(env, argv[0], &count);
+  if (status != napi_ok || count == 0) { throwException(env, "The AMR data must be a non-empty array."); return nullptr; }
+
+  std::vector<AmrFrames> frames(count);
+  for (uint32_t i=0; i<count; i++)
+  {
+    napi_value buffer;
+    status = napi_get_element(env, argv[0], i, &buffer);
+    if (status != napi_ok) { throwException(env, "Failed to get the AMR data buffer."); return nullptr; }
+    if (!getAMRFrames(env, buffer, 0, HUGE_VAL, frames[i])) return nullptr;
+  }
+
+  return resolveAMRFrames(env, deferred, promise, frames);
+}
+
+// Cut the AMR/NB/WB data at the frame boundaries (20 ms), without transcoding.
+// arg[0]: amrdata  (uint8array or buffer)
+// arg[1]: start (ms)
+// arg[2]: end (ms)
+// return: amrdata  (buffer)
+napi_value amrCut(napi_env env, napi_callback_info args)
+{
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 3;
+  napi_value argv[3];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the range.
+  double startMs, endMs;
+  status = napi_get_value_double(env, argv[1], &startMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the start time."); return nullptr; }
+  status = napi_get_value_double(env, argv[2], &endMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the end time."); return nullptr; }
+
+  std::vector<AmrFrames> frames(1);
+  if (!getAMRFrames(env, argv[0], startMs, endMs, frames[0])) return nullptr;
+
+  return resolveAMRFrames(env, deferred, promise, frames);
+}
+
+// Replace a range of the AMR/NB/WB data with another one, at the frame boundaries (20 ms), without transcoding.
+// arg[0]: amrdata  (uint8array or buffer)
+// arg[1]: start (ms)
+// arg[2]: end (ms), the same as the start to insert only.
+// arg[3]: amrdata to insert  (uint8array or buffer, the same type)
+// return: amrdata  (buffer)
+napi_value amrSplice(napi_env env, napi_callback_info args)
+{
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the range.
+  double startMs, endMs;
+  status = napi_get_value_double(env, argv[1], &startMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the start time."); return nullptr; }
+  status = napi_get_value_double(env, argv[2], &endMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the end time."); return nullptr; }
+  if (endMs < startMs) endMs = startMs;
+
+  std::vector<AmrFrames> frames(3);
+  if (!getAMRFrames(env, argv[0], 0, startMs, frames[0])) return nullptr;
+  if (!getAMRFrames(env, argv[3], 0, HUGE_VAL, frames[1])) return nullptr;
+  if (!getAMRFrames(env, argv[0], endMs, HUGE_VAL, frames[2])) return nullptr;
+
+  return resolveAMRFrames(env, deferred, promise, frames);
+}
+
+// Get the bytes of a Uint8Array (or Buffer), read or written in place.
+static bool getUint8Array(napi_env env, napi_value value, uint8_t** data, size_t* length, const char* error)
+{
+  napi_typedarray_type type;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, value, &type, length, (void**) data, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_uint8_array) { throwException(env, error); return false; }
+
+  return true;
+}
+
+// Pack the AMR/NB/WB frames into RTP payloads (RFC 4867, octet-aligned), back to back in the caller's buffer.
+// Each payload of 'framesPerPacket' frames takes at most 1 + 61 * framesPerPacket bytes.
+// arg[0]: amrdata  (uint8array or buffer)
+// arg[1]: framesPerPacket
+// arg[2]: output  (uint8array or buffer, filled with as many payloads as it holds)
+// arg[3]: position (optional): where to resume in the amrdata, 0 by default.
+// return: { sizes: the payload sizes (int32array), position: where to resume, amrdata.length once done }
+napi_value amrPacketize(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok || argc < 3) { throwException(env, "Expect the amrdata, framesPerPacket and output arguments."); return nullptr; }
+
+  uint8_t* data;
+  size_t length;
+  if (!getUint8Array(env, argv[0], &data, &length, "Failed to get the AMR data buffer.")) return nullptr;
+
+  int32_t framesPerPacket;
+  status = napi_get_value_int32(env, argv[1], &framesPerPacket);
+  if (status != napi_ok || framesPerPacket <= 0) { throwException(env, "The framesPerPacket should be a positive integer."); return nullptr; }
+
+  uint8_t* output;
+  size_t capacity;
+  if (!getUint8Array(env, argv[2], &output, &capacity, "Failed to get the output buffer.")) return nullptr;
+
+  int32_t position = 0;
+  if (argc > 3) {
+    status = napi_get_value_int32(env, argv[3], &position);
+    if (status != napi_ok || position < 0) { throwException(env, "The position should be a non-negative integer."); return nullptr; }
+  }
+
+  // Fill the output with the payloads.
+  std::vector<int32_t> sizes;
+  size_t used = 0;
+  while (true)
+  {
+    int rc = amrPacketize((char*)data, length, &position, framesPerPacket, (char*)output + used, capacity - used);
+    if (rc < 0) { throwException(env, "Invalid AMR data."); return nullptr; }
+    if (rc == 0) break;
+    sizes.push_back(rc);
+    used += rc;
+  }
+
+  // Set the return value.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  napi_value arraybuffer;
+  int32_t* sizesData = NULL;
+  status = napi_create_arraybuffer(env, sizes.size() * sizeof(int32_t), (void**)&sizesData, &arraybuffer);
+  if (status != napi_ok) return nullptr;
+  if (!sizes.empty()) memcpy(sizesData, sizes.data(), sizes.size() * sizeof(int32_t));
+  napi_value sizesArray;
+  status = napi_create_typedarray(env, napi_int32_array, sizes.size(), arraybuffer, 0, &sizesArray);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "sizes", sizesArray);
+  if (status != napi_ok) return nullptr;
+
+  napi_value next;
+  status = napi_create_int32(env, position, &next);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "position", next);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Unpack an RTP payload (RFC 4867, octet-aligned) into the AMR frames (without the '#!AMR' header), in the caller's buffer.
+// arg[0]: payload  (uint8array or buffer)
+// arg[1]: sample rate (8000: AMR-NB, 16000: AMR-WB)
+// arg[2]: output  (uint8array or buffer), which takes at most payload.length - 1 bytes.
+// arg[3]: offset (optional): where to write in the output, 0 by default.
+// return: the number of bytes written
+napi_value amrDepacketize(napi_env env, napi_callback_info args)
+{
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok || argc < 3) { throwException(env, "Expect the payload, samplerate and output arguments."); return nullptr; }
+
+  uint8_t* payload;
+  size_t length;
+  if (!getUint8Array(env, argv[0], &payload, &length, "Failed to get the payload buffer.")) return nullptr;
+
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[1], &sampleRate);
+  if (status != napi_ok || (sampleRate != 8000 && sampleRate != 16000)) { throwException(env, "The sample rate should be 8000 (AMR-NB) or 16000 (AMR-WB)."); return nullptr; }
+
+  uint8_t* output;
+  size_t capacity;
+  if (!getUint8Array(env, argv[2], &output, &capacity, "Failed to get the output buffer.")) return nullptr;
+
+  int32_t offset = 0;
+  if (argc > 3) {
+    status = napi_get_value_int32(env, argv[3], &offset);
+    if (status != napi_ok || offset < 0 || (size_t)offset > capacity) { throwException(env, "The offset is out of the output buffer."); return nullptr; }
+  }
+
+  int rc = amrDepacketize((char*)payload, length, (sampleRate==8000) ? AMR_NB : AMR_WB, (char*)output + offset, capacity - offset);
+  if (rc < 0) { throwException(env, "Invalid AMR RTP payload."); return nullptr; }
+  if (rc == 0) { throwException(env, "The output buffer is too small."); return nullptr; }
+
+  // Set the return value.
+  napi_value result;
+  status = napi_create_int32(env, rc, &result);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Configure the pool of the AMR codec contexts.
+// arg[0]: options { size: the idle contexts kept per codec, warmUp: the contexts to create now per codec }
+// return: the pool size
+napi_value configureAmrPool(napi_env env, napi_callback_info args)
+{
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 1;
+  napi_value argv[1];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the options.
+  napi_value options = (argc > 0) ? argv[0] : NULL;
+  int32_t size = AMR_POOL_SIZE;
+  int32_t warmUp = 0;
+  if (!getOptionInt32(env, options, "size", &size)) { throwException(env, "The size option must be a number."); return nullptr; }
+  if (!getOptionInt32(env, options, "warmUp", &warmUp)) { throwException(env, "The warmUp option must be a number."); return nullptr; }
+  if (size < 0 || warmUp < 0) { throwException(env, "The pool size must not be negative."); return nullptr; }
+
+  setAMRPoolSize(size);
+  if (warmUp > size) warmUp = size;
+  warmUpAMRPool(warmUp);
+
+  // Set the return value.
+  napi_value result;
+  status = napi_create_int32(env, size, &result);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Get the number of invalid AMR frames met since the module load.
+// return: { shortFrame, badToc, badFrameType, sizeMismatch }
+napi_value amrFrameErrors(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  const char* names[AMR_NB_ERRORS] = { NULL, "shortFrame", "badToc", "badFrameType", "sizeMismatch" };
+  for (int i=AMR_ERROR_SHORT_FRAME; i<AMR_NB_ERRORS; i++)
+  {
+    napi_value count;
+    status = napi_create_int64(env, getAMRErrorCount((enum AMR_ERROR)i), &count);
+    if (status != napi_ok) return nullptr;
+    status = napi_set_named_property(env, result, names[i], count);
+    if (status != napi_ok) return nullptr;
+  }
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Create a Float32Array holding the PCM samples.
+static napi_value createPCMArray(napi_env env, const std::vector<short> &pcm)
+{
+  napi_status status;
+
+  size_t byte_length = pcm.size()*sizeof(float);
+  napi_value arraybuffer;
+  float* pcmdata = NULL;
+  status = napi_create_arraybuffer(env, byte_length, (void**)&pcmdata, &arraybuffer);
+  if (status != napi_ok) { throwException(env, "Failed to create the PCM buffer."); return nullptr; }
+  for (size_t i=0; i<pcm.size(); i++) pcmdata[i] = 1.0 * ((int) pcm[i]) / 32768;
+
+  napi_value pcmarray;
+  status = napi_create_typedarray(env, napi_float32_array, pcm.size(), arraybuffer, 0, &pcmarray);
+  if (status != napi_ok) { throwException(env, "Failed to create the PCM array."); return nullptr; }
+
+  return pcmarray;
+}
+
+static void finalizeAmrDecoder(napi_env env, void* data, void* hint)
+{
+  delete (AmrDecoder*) data;
+}
+
+// Get the native decoder wrapped by 'this'.
+static AmrDecoder* unwrapAmrDecoder(napi_env env, napi_callback_info args, size_t* argc, napi_value* argv, napi_value* jsthis)
+{
+  napi_status status = napi_get_cb_info(env, args, argc, argv, jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return NULL; }
+
+  AmrDecoder* decoder = NULL;
+  status = napi_unwrap(env, *jsthis, (void**)&decoder);
+  if (status != napi_ok) { throwException(env, "Failed to get the AMR decoder."); return NULL; }
+
+  return decoder;
+}
+
+// Create a streaming AMR decoder.
+static napi_value AmrDecoderConstructor(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  napi_value jsthis;
+  status = napi_get_cb_info(env, args, NULL, NULL, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  AmrDecoder* decoder = new AmrDecoder();
+  status = napi_wrap(env, jsthis, decoder, finalizeAmrDecoder, NULL, NULL);
+  if (status != napi_ok) { delete decoder; throwException(env, "Failed to wrap the AMR decoder."); return nullptr; }
+
+  return jsthis;
+}
+
+// Feed a chunk of the AMR stream.
+// arg[0]: amrdata (uint8array or buffer, any length)
+// return: the PCM of the frames completed by this chunk (float32array)
+static napi_value AmrDecoderProcess(napi_env env, napi_callback_info args)
+{
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_value jsthis;
+  AmrDecoder* decoder = unwrapAmrDecoder(env, args, &argc, argv, &jsthis);
+  if (decoder == NULL) return nullptr;
+
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_uint8_array) { throwException(env, "Failed to get the AMR data buffer."); return nullptr; }
+
+  bool isKnown = (decoder->getType() != AMR_UNKNOWN);
+  std::vector<short> pcm;
+  int rc = decoder->process((char*)dataptr, length, pcm);
+  if (rc < 0) { throwException(env, "Invalid AMR data."); return nullptr; }
+
+  // Set the sample rate once the header is known.
+  if (!isKnown && decoder->getType() != AMR_UNKNOWN)
+  {
+    napi_value samplerate;
+    status = napi_create_int32(env, decoder->getSampleRate(), &samplerate);
+    if (status != napi_ok) return nullptr;
+    status = napi_set_named_property(env, jsthis, "samplerate", samplerate);
+    if (status != napi_ok) return nullptr;
+  }
+
+  return createPCMArray(env, pcm);
+}
+
+// End of the stream. The incomplete frame is dropped and the decoder could be reused for another stream.
+// return: an empty float32array
+static napi_value AmrDecoderFlush(napi_env env, napi_callback_info args)
+{
+  size_t argc = 0;
+  napi_value jsthis;
+  AmrDecoder* decoder = unwrapAmrDecoder(env, args, &argc, NULL, &jsthis);
+  if (decoder == NULL) return nullptr;
+
+  decoder->reset();
+
+  return createPCMArray(env, std::vector<short>());
+}
+
+// Define the 'AmrDecoder' class.
+napi_value defineAmrDecoder(napi_env env)
+{
+  napi_property_descriptor properties[] = {
+    { "process", NULL, AmrDecoderProcess, NULL, NULL, NULL, napi_default, NULL },
+    { "flush", NULL, AmrDecoderFlush, NULL, NULL, NULL, napi_default, NULL },
+  };
+
+  napi_value constructor;
+  napi_status status = napi_define_class(env, "AmrDecoder", NAPI_AUTO_LENGTH, AmrDecoderConstructor, NULL,
+                                         sizeof(properties)/sizeof(properties[0]), properties, &constructor);
+  if (status != napi_ok) return nullptr;
+
+  return constructor;
+}
+
+
+// Create a Buffer holding the AMR bytes.
+static napi_value createAMRBuffer(napi_env env, const std::vector<char> &amr)
+{
+  napi_value buffer;
+  napi_status status = napi_create_buffer_copy(env, amr.size(), amr.data(), NULL, &buffer);
+  if (status != napi_ok) { throwException(env, "Failed to create the AMR buffer."); return nullptr; }
+
+  return buffer;
+}
+
+static void finalizeAmrEncoder(napi_env env, void* data, void* hint)
+{
+  delete (AmrEncoder*) data;
+}
+
+// Get the native encoder wrapped by 'this'.
+static AmrEncoder* unwrapAmrEncoder(napi_env env, napi_callback_info args, size_t* argc, napi_value* argv)
+{
+  napi_value jsthis;
+  napi_status status = napi_get_cb_info(env, args, argc, argv, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return NULL; }
+
+  AmrEncoder* encoder = NULL;
+  status = napi_unwrap(env, jsthis, (void**)&encoder);
+  if (status != napi_ok) { throwException(env, "Failed to get the AMR encoder."); return NULL; }
+
+  return encoder;
+}
+
+// Create a streaming AMR-NB encoder.
+// arg[0]: sample rate of the input
+// arg[1]: mode: (0: 4.75k, 1: 5.15k, 2: 5.90k, 3: 6.70k, 4: 7.40k, 5: 7.95k, 6: 10.2k, 7: 12.2k)
+static napi_value AmrEncoderConstructor(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_value jsthis;
+  status = napi_get_cb_info(env, args, &argc, argv, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[0], &sampleRate);
+  if (status != napi_ok || sampleRate <= 0) { throwException(env, "Failed to create the sample rate variable."); return nullptr; }
+
+  // -- Get the AMR rate mode.
+  int32_t mode;
+  status = napi_get_value_int32(env, argv[1], &mode);
+  if (status != napi_ok) { throwException(env, "Failed to get the AMR mode."); return nullptr; }
+
+  AmrEncoder* encoder = new AmrEncoder(sampleRate, mode);
+  status = napi_wrap(env, jsthis, encoder, finalizeAmrEncoder, NULL, NULL);
+  if (status != napi_ok) { delete encoder; throwException(env, "Failed to wrap the AMR encoder."); return nullptr; }
+
+  return jsthis;
+}
+
+// Feed a chunk of PCM.
+// arg[0]: pcmdata (float32array within [-1, 1], any length)
+// return: the AMR bytes of the frames completed by this chunk, the header first (buffer)
+static napi_value AmrEncoderProcess(napi_env env, napi_callback_info args)
+{
+  size_t argc = 1;
+  napi_value argv[1];
+  AmrEncoder* encoder = unwrapAmrEncoder(env, args, &argc, argv);
+  if (encoder == NULL) return nullptr;
+
+  float* data;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_float32_array) { throwException(env, "Failed to get the PCM data buffer."); return nullptr; }
+
+  std::vector<char> amr;
+  if (encoder->process(data, length, amr) < 0) { throwException(env, "Failed to resample the PCM data."); return nullptr; }
+
+  return createAMRBuffer(env, amr);
+}
+
+// End of the stream. The encoder could then be reused for another stream.
+// return: the AMR bytes of the last frames (buffer)
+static napi_value AmrEncoderFlush(napi_env env, napi_callback_info args)
+{
+  size_t argc = 0;
+  AmrEncoder* encoder = unwrapAmrEncoder(env, args, &argc, NULL);
+  if (encoder == NULL) return nullptr;
+
+  std::vector<char> amr;
+  if (encoder->flush(amr) < 0) { throwException(env, "Failed to resample the PCM data."); return nullptr; }
+
+  return createAMRBuffer(env, amr);
+}
+
+// Define the 'AmrEncoder' class.
+napi_value defineAmrEncoder(napi_env env)
+{
+  napi_property_descriptor properties[] = {
+    { "process", NULL, AmrEncoderProcess, NULL, NULL, NULL, napi_default, NULL },
+    { "flush", NULL, AmrEncoderFlush, NULL, NULL, NULL, napi_default, NULL },
+  };
+
+  napi_value constructor;
+  napi_status status = napi_define_class(env, "AmrEncoder", NAPI_AUTO_LENGTH, AmrEncoderConstructor, NULL,
+                                         sizeof(properties)/sizeof(properties[0]), properties, &constructor);
+  if (status != napi_ok) return nullptr;
+
+  return constructor;
+}
@@ -10,6 +10,9 @@
  * 
  ************************************************/
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "napi_common.h"
 
@@ -21,3 +24,133 @@ void throwException(napi_env env, const char* error)
   napi_throw_error(env, code, error);
 }
 
+
+// Get the named property of the options object, NULL if there is no such option.
+static napi_value getOption(napi_env env, napi_value options, const char* name)
+{
+  napi_valuetype valuetype = napi_undefined;
+  if (options == NULL || napi_typeof(env, options, &valuetype) != napi_ok || valuetype != napi_object) return NULL;
+
+  bool hasOption = false;
+  if (napi_has_named_property(env, options, name, &hasOption) != napi_ok || !hasOption) return NULL;
+
+  napi_value option;
+  if (napi_get_named_property(env, options, name, &option) != napi_ok) return NULL;
+
+  if (napi_typeof(env, option, &valuetype) != napi_ok || valuetype == napi_undefined) return NULL;
+
+  return option;
+}
+
+bool getOptionBool(napi_env env, napi_value options, const char* name, bool* value)
+{
+  napi_value option = getOption(env, options, name);
+  if (option == NULL) return true;
+
+  return napi_get_value_bool(env, option, value) == napi_ok;
+}
+
+bool getOptionInt32(napi_env env, napi_value options, const char* name, int32_t* value)
+{
+  napi_value option = getOption(env, options, name);
+  if (option == NULL) return true;
+
+  return napi_get_value_int32(env, option, value) == napi_ok;
+}
+
+bool getOptionDouble(napi_env env, napi_value options, const char* name, double* value)
+{
+  napi_value option = getOption(env, options, name);
+  if (option == NULL) return true;
+
+  return napi_get_value_double(env, option, value) == napi_ok;
+}
+
+
+bool AsyncTask::keep(napi_env env, napi_value value)
+{
+  napi_ref reference;
+  if (napi_create_reference(env, value, 1, &reference) != napi_ok) { m_error = "Failed to keep the input alive."; return false; }
+  m_references.push_back(reference);
+  return true;
+}
+
+static void executeAsyncTask(napi_env env, void* data)
+{
+  AsyncTask* task = (AsyncTask*) data;
+  if (task->m_error == NULL) task->execute();
+}
+
+static void completeAsyncTask(napi_env env, napi_status status, void* data)
+{
+  AsyncTask* task = (AsyncTask*) data;
+
+  napi_value result = nullptr;
+  if (status == napi_ok && task->m_error == NULL)
+  {
+    result = task->complete(env);
+    if (result == nullptr) task->m_error = "Failed to create the result.";
+  }
+
+  if (result != nullptr) napi_resolve_deferred(env, task->m_deferred, result);
+  else
+  {
+    napi_value message, error;
+    napi_create_string_utf8(env, (task->m_error != NULL) ? task->m_error : "The task is cancelled.", NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, NULL, message, &error);
+    napi_reject_deferred(env, task->m_deferred, error);
+  }
+
+  for (size_t i=0; i<task->m_references.size(); i++) napi_delete_reference(env, task->m_references[i]);
+  napi_delete_async_work(env, task->m_work);
+  delete task;
+}
+
+// Throw, and free the task which could not be queued.
+static napi_value discardAsyncTask(napi_env env, AsyncTask* task, const char* error)
+{
+  for (size_t i=0; i<task->m_references.size(); i++) napi_delete_reference(env, task->m_references[i]);
+  delete task;
+  throwException(env, error);
+  return nullptr;
+}
+
+napi_value queueAsyncTask(napi_env env, const char* name, AsyncTask* task)
+{
+  napi_status status;
+
+  napi_value promise;
+  status = napi_create_promise(env, &task->m_deferred, &promise);
+  if (status != napi_ok) return discardAsyncTask(env, task, "Failed to create the promise object.");
+
+  napi_value resourceName;
+  status = napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resourceName);
+  if (status != napi_ok) return discardAsyncTask(env, task, "Failed to create the async work.");
+  status = napi_create_async_work(env, NULL, resourceName, executeAsyncTask, completeAsyncTask, task, &task->m_work);
+  if (status != napi_ok) return discardAsyncTask(env, task, "Failed to create the async work.");
+  status = napi_queue_async_work(env, task->m_work);
+  if (status != napi_ok)
+  {
+    napi_delete_async_work(env, task->m_work);
+    return discardAsyncTask(env, task, "Failed to queue the async work.");
+  }
+
+  return promise;
+}
+
+static void freeArrayBuffer(napi_env env, void* data, void* hint)
+{
+  free(data);
+}
+
+napi_value createArrayBufferFrom(napi_env env, void* data, size_t byteLength)
+{
+  napi_value arraybuffer;
+  if (byteLength > 0 && napi_create_external_arraybuffer(env, data, byteLength, freeArrayBuffer, NULL, &arraybuffer) == napi_ok) return arraybuffer;
+
+  void* copy = NULL;
+  napi_status status = napi_create_arraybuffer(env, byteLength, &copy, &arraybuffer);
+  if (status == napi_ok && byteLength > 0) memcpy(copy, data, byteLength);
+  free(data);
+  return (status == napi_ok) ? arraybuffer : nullptr;
+}
@@ -0,0 +1,197 @@
+/*************************************************
+ *
+ * Decode the AMR and MP3 files on a worker thread.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "amr.h"
+#include "minimp3.h"
+#include "mp3.h"
+
+#include "napi_file.h"
+#include "napi_common.h"
+
+
+enum FILE_FORMAT
+{
+  FILE_MP3,
+  FILE_AMR
+};
+
+// Map the file and decode it on a worker thread.
+class DecodeFileTask : public AsyncTask
+{
+
+public:
+
+  virtual ~DecodeFileTask() { free(m_pcm); };
+
+  // Worker thread: map the file, and decode it.
+  // The pages are read by the kernel as the decoder walks through them, and never copied into the JS heap.
+  virtual void execute()
+  {
+    mp3dec_map_info_t map;
+    if (mp3dec_open_file_lazy(m_path.c_str(), &map) < 0) { m_error = "Failed to open the file."; return; }
+
+    if (m_format == FILE_MP3) decodeMP3(map.buffer, map.size);
+    else decodeAMR(map.buffer, map.size);
+
+    mp3dec_close_file(&map);
+  };
+
+  // JS thread: create the resulting object { pcm, bitdepth, samplerate, channels }.
+  virtual napi_value complete(napi_env env);
+
+  // Input.
+  std::string m_path;
+  enum FILE_FORMAT m_format;
+  int m_nbThreads = 1;
+
+private:
+
+  void decodeMP3(const uint8_t* data, size_t size);
+  void decodeAMR(const uint8_t* data, size_t size);
+
+  // Output: 'm_pcm' is allocated by malloc(), and handed over to the ArrayBuffer.
+  float* m_pcm = NULL;
+  size_t m_samples = 0;
+  int m_sampleRate = 0;
+  int m_channels = 1;
+};
+
+
+void DecodeFileTask::decodeMP3(const uint8_t* data, size_t size)
+{
+  // The same as mp32pcm(): size the buffer by a scan of the frame headers, and decode straight into it.
+  mp3dec_file_info_t info;
+  decodeMp3(data, size, m_nbThreads, &info);
+  if (info.buffer == NULL) { m_error = "Failed to decode the MP3 file."; return; }
+#ifdef MINIMP3_FLOAT_OUTPUT
+  m_pcm = info.buffer;
+#else
+  m_pcm = (float*) malloc(info.samples*sizeof(float));
+  if (m_pcm != NULL) for (size_t i=0; i<info.samples; i++) m_pcm[i] = 1.0 * ((int) info.buffer[i]) / 32768;
+  free(info.buffer);
+  if (m_pcm == NULL) { m_error = "Failed to allocate the PCM buffer."; return; }
+#endif
+  m_samples = info.samples;
+  m_sampleRate = info.hz;
+  m_channels = info.channels;
+}
+
+void DecodeFileTask::decodeAMR(const uint8_t* data, size_t size)
+{
+  if (size > INT_MAX) { m_error = "The AMR file is too large."; return; }
+
+  // NOTE: The decoder only reads the data, so it could work on the read-only mapping.
+  char* amrData = (char*) data;
+  AMR_TYPE type = getAMRType(amrData, size);
+  if (type == AMR_UNKNOWN) { m_error = "Unknown AMR header."; return; }
+  int samples = getSampleCount(amrData, size, type);
+  short* pcm = amr2pcm(amrData, size);
+  if (pcm == NULL) { m_error = "Failed to decode the AMR file."; return; }
+
+  m_pcm = (float*) malloc((samples > 0 ? samples : 1)*sizeof(float));
+  if (m_pcm == NULL) { free(pcm); m_error = "Failed to allocate the PCM buffer."; return; }
+  for (int i=0; i<samples; i++) m_pcm[i] = 1.0 * ((int) pcm[i]) / 32768;
+  free(pcm); // Allocated by malloc() in amr2pcm().
+
+  m_samples = samples;
+  m_sampleRate = (type==AMR_NB) ? 8000 : 16000;
+}
+
+// Set an integer property of the object.
+static bool setInt32(napi_env env, napi_value object, const char* name, int number)
+{
+  napi_value value;
+  if (napi_create_int32(env, number, &value) != napi_ok) return false;
+  return napi_set_named_property(env, object, name, value) == napi_ok;
+}
+
+napi_value DecodeFileTask::complete(napi_env env)
+{
+  napi_status status;
+
+  // Hand the PCM buffer over to the ArrayBuffer, without a copy.
+  napi_value arraybuffer = createArrayBufferFrom(env, m_pcm, m_samples*sizeof(float));
+  m_pcm = NULL;
+  if (arraybuffer == nullptr) return nullptr;
+
+  napi_value pcmarray;
+  status = napi_create_typedarray(env, napi_float32_array, m_samples, arraybuffer, 0, &pcmarray);
+  if (status != napi_ok) return nullptr;
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "pcm", pcmarray);
+  if (status != napi_ok) return nullptr;
+  if (!setInt32(env, result, "bitdepth", 16)) return nullptr;
+  if (!setInt32(env, result, "samplerate", m_sampleRate)) return nullptr;
+  if (!setInt32(env, result, "channels", m_channels)) return nullptr;
+
+  return result;
+}
+
+// Parse the path (and the options), and queue the decoding.
+static napi_value decodeFile(napi_env env, napi_callback_info args, enum FILE_FORMAT format)
+{
+  napi_status status;
+
+  // Parse the input arguments.
+  size_t argc = 2;
+  napi_value argv[2];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok || argc < 1) { throwException(env, "The file path is missing."); return nullptr; }
+
+  // -- Get the path.
+  size_t length;
+  status = napi_get_value_string_utf8(env, argv[0], NULL, 0, &length);
+  if (status != napi_ok) { throwException(env, "The file path should be a string."); return nullptr; }
+  std::string path(length + 1, '\0');
+  status = napi_get_value_string_utf8(env, argv[0], &path[0], length + 1, &length);
+  if (status != napi_ok) return nullptr;
+  path.resize(length);
+
+  // -- Get the options.
+  napi_value options = (argc > 1) ? argv[1] : NULL;
+  int32_t nbThreads = 1;
+  if (!getOptionInt32(env, options, "threads", &nbThreads) || nbThreads < 0) { throwException(env, "The threads option should be a non-negative integer."); return nullptr; }
+
+  DecodeFileTask* task = new DecodeFileTask();
+  task->m_path = path;
+  task->m_format = format;
+  task->m_nbThreads = nbThreads;
+
+  return queueAsyncTask(env, (format == FILE_MP3) ? "mp32pcmFile" : "amr2pcmFile", task);
+}
+
+
+// Decode the MP3 file, mapped into the memory instead of read into a Buffer.
+// arg[0]: path (string)
+// arg[1]: options (optional) { threads: 1 by default, as mp32pcm() }
+// return: { pcm: float32array, bitdepth, samplerate, channels }
+napi_value mp32pcmFile(napi_env env, napi_callback_info args)
+{
+  return decodeFile(env, args, FILE_MP3);
+}
+
+// Decode the AMR NB/WB file, mapped into the memory instead of read into a Buffer.
+// arg[0]: path (string)
+// return: { pcm: float32array, bitdepth, samplerate, channels }
+napi_value amr2pcmFile(napi_env env, napi_callback_info args)
+{
+  return decodeFile(env, args, FILE_AMR);
+}
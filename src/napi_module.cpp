@@ -18,8 +18,12 @@
 #include "napi_pitch.h"
 #include "napi_amr.h"
 #include "napi_mp3.h"
+#include "napi_probe.h"
+#include "napi_file.h"
 #include "napi_resample.h"
 
+#include "amr.h"
+
 
 napi_value Method(napi_env env, napi_callback_info args) {
   napi_value greeting;
@@ -59,6 +63,24 @@ napi_value init(napi_env env, napi_value exports) {
   status = napi_set_named_property(env, exports, "detectPitch", fn);
   if (status != napi_ok) return nullptr;
 
+  // 'Export' the 'detectPitchBatch' function.
+  status = napi_create_function(env, nullptr, 0, detectPitchBatch, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "detectPitchBatch", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'detectPitchEnsemble' function.
+  status = napi_create_function(env, nullptr, 0, detectPitchEnsemble, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "detectPitchEnsemble", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'PitchTracker' class.
+  fn = definePitchTracker(env);
+  if (fn == nullptr) return nullptr;
+  status = napi_set_named_property(env, exports, "PitchTracker", fn);
+  if (status != napi_ok) return nullptr;
+
   // 'Export' the 'ampfreq' function.
   status = napi_create_function(env, nullptr, 0, ampfreq, nullptr, &fn);
   if (status != napi_ok) return nullptr;
@@ -89,12 +111,36 @@ napi_value init(napi_env env, napi_value exports) {
   status = napi_set_named_property(env, exports, "amr2pcm", fn);
   if (status != napi_ok) return nullptr;
 
+  // 'Export' the 'amr2pcmBatch' function.
+  status = napi_create_function(env, nullptr, 0, amr2pcmBatch, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amr2pcmBatch", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrIndex' function.
+  status = napi_create_function(env, nullptr, 0, amrIndex, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrIndex", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrDecodeRange' function.
+  status = napi_create_function(env, nullptr, 0, amrDecodeRange, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrDecodeRange", fn);
+  if (status != napi_ok) return nullptr;
+
   // 'Export' the 'pcm2amr' function.
   status = napi_create_function(env, nullptr, 0, pcm2amr, nullptr, &fn);
   if (status != napi_ok) return nullptr;
   status = napi_set_named_property(env, exports, "pcm2amr", fn);
   if (status != napi_ok) return nullptr;
 
+  // 'Export' the 'pcm2amrwb' function.
+  status = napi_create_function(env, nullptr, 0, pcm2amrwb, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "pcm2amrwb", fn);
+  if (status != napi_ok) return nullptr;
+
   // 'Export' the 'wav2amr' function.
   status = napi_create_function(env, nullptr, 0, wav2amr, nullptr, &fn);
   if (status != napi_ok) return nullptr;
@@ -107,6 +153,99 @@ napi_value init(napi_env env, napi_value exports) {
   status = napi_set_named_property(env, exports, "mp32pcm", fn);
   if (status != napi_ok) return nullptr;
 
+  // 'Export' the 'mp32pcmFile' function.
+  status = napi_create_function(env, nullptr, 0, mp32pcmFile, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "mp32pcmFile", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amr2pcmFile' function.
+  status = napi_create_function(env, nullptr, 0, amr2pcmFile, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amr2pcmFile", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'mp3Index' function.
+  status = napi_create_function(env, nullptr, 0, mp3Index, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "mp3Index", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'mp3DecodeRange' function.
+  status = napi_create_function(env, nullptr, 0, mp3DecodeRange, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "mp3DecodeRange", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'Mp3Decoder' class.
+  fn = defineMp3Decoder(env);
+  if (fn == nullptr) return nullptr;
+  status = napi_set_named_property(env, exports, "Mp3Decoder", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'probe' function.
+  status = napi_create_function(env, nullptr, 0, probe, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "probe", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrConcat' function.
+  status = napi_create_function(env, nullptr, 0, amrConcat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrConcat", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrCut' function.
+  status = napi_create_function(env, nullptr, 0, amrCut, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrCut", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrSplice' function.
+  status = napi_create_function(env, nullptr, 0, amrSplice, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrSplice", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrPacketize' function.
+  status = napi_create_function(env, nullptr, 0, amrPacketize, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrPacketize", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrDepacketize' function.
+  status = napi_create_function(env, nullptr, 0, amrDepacketize, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrDepacketize", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'configureAmrPool' function.
+  status = napi_create_function(env, nullptr, 0, configureAmrPool, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "configureAmrPool", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'AmrEncoder' class.
+  fn = defineAmrEncoder(env);
+  if (fn == nullptr) return nullptr;
+  status = napi_set_named_property(env, exports, "AmrEncoder", fn);
+  if (status != napi_ok) return nullptr;
+
+  // 'Export' the 'amrFrameErrors' function.
+  status = napi_create_function(env, nullptr, 0, amrFrameErrors, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "amrFrameErrors", fn);
+  if (status != napi_ok) return nullptr;
+
+  // Create the AMR codec contexts up front.
+  warmUpAMRPool(AMR_POOL_WARM_UP);
+
+  // 'Export' the 'AmrDecoder' class.
+  fn = defineAmrDecoder(env);
+  if (fn == nullptr) return nullptr;
+  status = napi_set_named_property(env, exports, "AmrDecoder", fn);
+  if (status != napi_ok) return nullptr;
+
   // 'Export' the 'amr_remove_silence' function.
   status = napi_create_function(env, nullptr, 0, amr_remove_silence, nullptr, &fn);
   if (status != napi_ok) return nullptr;
@@ -11,17 +11,85 @@
  ************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <vector>
 
 #include "minimp3.h"
+#include "mp3.h"
 
 #include "napi_mp3.h"
 #include "napi_common.h"
 
 
+// Decode the MP3 data by segments in parallel, on a worker thread.
+class Mp3DecodeTask : public AsyncTask
+{
+
+public:
+
+  virtual ~Mp3DecodeTask() { free(m_info.buffer); };
+
+  virtual void execute()
+  {
+    decodeMp3(m_data, m_length, m_nbThreads, &m_info);
+    if (m_info.buffer == NULL) m_error = "Failed to decode the MP3 data.";
+  };
+
+  // Create the resulting object { pcm, bitdepth, samplerate }, as the serial decoding does.
+  virtual napi_value complete(napi_env env)
+  {
+    napi_value result;
+    napi_status status = napi_create_object(env, &result);
+    if (status != napi_ok) return nullptr;
+
+    size_t samples = m_info.samples;
+#ifdef MINIMP3_FLOAT_OUTPUT
+    napi_value arraybuffer = createArrayBufferFrom(env, m_info.buffer, samples*sizeof(float));
+    m_info.buffer = NULL;
+    if (arraybuffer == nullptr) return nullptr;
+#else
+    napi_value arraybuffer;
+    float* pcmdata = NULL;
+    status = napi_create_arraybuffer(env, samples*sizeof(float), (void**)&pcmdata, &arraybuffer);
+    if (status != napi_ok) return nullptr;
+    for (size_t i=0; i<samples; i++) pcmdata[i] = 1.0 * ((int) m_info.buffer[i]) / 32768;
+#endif
+    napi_value pcmarray;
+    status = napi_create_typedarray(env, napi_float32_array, samples, arraybuffer, 0, &pcmarray);
+    if (status != napi_ok) return nullptr;
+
+    napi_value samplerate, bitdepth;
+    status = napi_create_int32(env, m_info.hz, &samplerate);
+    if (status != napi_ok) return nullptr;
+    status = napi_create_int32(env, 16, &bitdepth);
+    if (status != napi_ok) return nullptr;
+
+    status = napi_set_named_property(env, result, "pcm", pcmarray);
+    if (status != napi_ok) return nullptr;
+    status = napi_set_named_property(env, result, "bitdepth", bitdepth);
+    if (status != napi_ok) return nullptr;
+    status = napi_set_named_property(env, result, "samplerate", samplerate);
+    if (status != napi_ok) return nullptr;
+
+    return result;
+  };
+
+  // Input: the data points into the JS buffer, kept alive by keep().
+  const uint8_t* m_data = NULL;
+  size_t m_length = 0;
+  int32_t m_nbThreads = 0;
+
+private:
+
+  mp3dec_file_info_t m_info = {};
+};
+
 
 // Decode the MP3 data.
 // arg[0]: mp3data  (uint8array)
+// arg[1]: options (optional) { threads: 1 by default, to decode the segments of a long stream in parallel (0: one per core) }
+//         With threads, the data is decoded on a worker thread: it must not be changed until the promise is settled.
 // return: pcmdata  (float32array)
 napi_value mp32pcm(napi_env env, napi_callback_info args)
 {
@@ -31,19 +99,16 @@ napi_value mp32pcm(napi_env env, napi_callback_info args)
 
   napi_status status;
 
-  // Create the promise.
-  status = napi_create_promise(env, &deferred, &promise);
-  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
-
-  // Create the resulting object.
-  status = napi_create_object(env, &result);
-  if (status != napi_ok) return nullptr;
-
   // Parse the input arguments.
-  size_t argc = 1;
-  napi_value argv[1];
+  size_t argc = 2;
+  napi_value argv[2];
   status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
 
+  // -- Get the options.
+  napi_value options = (argc > 1) ? argv[1] : NULL;
+  int32_t nbThreads = 1;
+  if (!getOptionInt32(env, options, "threads", &nbThreads) || nbThreads < 0) { throwException(env, "The threads option should be a non-negative integer."); return nullptr; }
+
   // -- Get the data buffer.
   uint8_t* dataptr;
   napi_typedarray_type type;
@@ -53,26 +118,62 @@ napi_value mp32pcm(napi_env env, napi_callback_info args)
   status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
   if (status != napi_ok) return nullptr;
 
+  // Decode the segments in parallel, on a worker thread.
+  if (nbThreads != 1)
+  {
+    Mp3DecodeTask* task = new Mp3DecodeTask();
+    task->m_data = dataptr;
+    task->m_length = length;
+    task->m_nbThreads = nbThreads;
+    task->keep(env, argv[0]);
+    return queueAsyncTask(env, "mp32pcm", task);
+  }
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
   // Convert MP3 data
   mp3dec_t mp3d;
   mp3dec_file_info_t info;
+  byte_offset = 0;
+  float* pcmdata = NULL;
+#ifdef MINIMP3_FLOAT_OUTPUT
+  // Size the ArrayBuffer by a scan of the frame headers, and decode straight into it.
+  // NOTE: The frames dropped by the decoder (e.g., a missing bit reservoir) leave some unused room at its end.
+  size_t capacity = mp3dec_count_samples((const uint8_t*)dataptr, length);
+  if (capacity == 0) return nullptr;
+  status = napi_create_arraybuffer(env, capacity*sizeof(float), (void**)&pcmdata, &arraybuffer);
+  if (status != napi_ok) return nullptr;
+  int ret = mp3dec_load_buf_into(&mp3d, (const uint8_t*)dataptr, length, pcmdata, capacity, &info);
+  if (ret < 0)
+  {
+    // A corrupted stream, where the decoder finds more frames than the scan: decode again into a growing buffer.
+    mp3dec_load_buf(&mp3d, (const uint8_t*)dataptr, length, &info, 0, 0);
+    status = napi_create_arraybuffer(env, info.samples*sizeof(float), (void**)&pcmdata, &arraybuffer);
+    if (status != napi_ok) { free(info.buffer); return nullptr; }
+    memcpy(pcmdata, info.buffer, info.samples*sizeof(float));
+    free(info.buffer); // Allocated by malloc() in mp3dec_load_buf().
+  }
+  int samples = info.samples;
+  if(samples == 0 ) return nullptr;
+#else
   mp3dec_load_buf(&mp3d, (const uint8_t*)dataptr, length, &info, 0, 0);
   int samples = info.samples;
   if(samples == 0 ) return nullptr;
-  short* pcm = info.buffer;
-  //int16_t *buffer = malloc(info.samples*sizeof(int16_t));
-  //mp3dec_f32_to_s16(info.buffer, buffer, info.samples);
-  //free(info.buffer);
+  mp3d_sample_t* pcm = info.buffer;
 
   // Set the return value.
-  size_t byte_length = samples*sizeof(float);
-  byte_offset = 0;
   // -- First, create the ArrayBuffer.
-  float* pcmdata = NULL;
-  status = napi_create_arraybuffer(env, byte_length, (void**)&pcmdata, &arraybuffer);
+  status = napi_create_arraybuffer(env, samples*sizeof(float), (void**)&pcmdata, &arraybuffer);
   if (status != napi_ok) return nullptr;
   for (int i=0; i<samples; i++) pcmdata[i] = 1.0 * ((int) pcm[i]) / 32768; // NOTE: 1. Must convert 'short' to 'int'. 2. Must divide the value by 32768. Otherwise, no sound could be played, although the values are there.
-  delete [] pcm;
+  free(pcm); // Allocated by malloc() in mp3dec_load_buf().
+#endif
   // -- Second, create the TypedArray.
   napi_value pcmarray;
   status = napi_create_typedarray(env, napi_float32_array, samples, arraybuffer, byte_offset, &pcmarray);
@@ -106,3 +207,336 @@ napi_value mp32pcm(napi_env env, napi_callback_info args)
 
   return promise;
 }
+
+
+// Create a Float32Array holding the PCM samples.
+static napi_value createFloatArray(napi_env env, const std::vector<float> &pcm)
+{
+  napi_value arraybuffer;
+  float* pcmdata = NULL;
+  napi_status status = napi_create_arraybuffer(env, pcm.size()*sizeof(float), (void**)&pcmdata, &arraybuffer);
+  if (status != napi_ok) { throwException(env, "Failed to create the PCM buffer."); return nullptr; }
+  if (!pcm.empty()) memcpy(pcmdata, pcm.data(), pcm.size()*sizeof(float));
+
+  napi_value pcmarray;
+  status = napi_create_typedarray(env, napi_float32_array, pcm.size(), arraybuffer, 0, &pcmarray);
+  if (status != napi_ok) { throwException(env, "Failed to create the PCM array."); return nullptr; }
+
+  return pcmarray;
+}
+
+// Build the seek index of the MP3 data, by walking the frame headers only.
+// arg[0]: mp3data  (uint8array or buffer)
+// arg[1]: step (optional, 1 by default): index every 'step'-th frame
+// return: { index, frames, duration, samplerate, channels }
+//         index: the serialized index (buffer), which could be cached next to the file.
+//         duration: in ms.
+napi_value mp3Index(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  // Parse the input arguments.
+  size_t argc = 2;
+  napi_value argv[2];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the data buffer.
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok) { throwException(env, "Failed to get the MP3 data buffer."); return nullptr; }
+
+  // -- Get the step.
+  int32_t step = 1;
+  if (argc > 1)
+  {
+    status = napi_get_value_int32(env, argv[1], &step);
+    if (status != napi_ok || step <= 0) { throwException(env, "The step must be a positive number."); return nullptr; }
+  }
+
+  // Build the index.
+  Mp3Index index;
+  if (buildMp3Index(dataptr, length, step, index) < 0) { throwException(env, "Invalid MP3 data."); return nullptr; }
+
+  // Set the return value as Buffer.
+  int szIndex = 0;
+  char* serialized = serializeMp3Index(index, &szIndex);
+  napi_value buffer;
+  char* indexdata = NULL;
+  status = napi_create_buffer(env, szIndex, (void**)&indexdata, &buffer);
+  if (status != napi_ok) { free(serialized); return nullptr; }
+  memcpy(indexdata, serialized, szIndex);
+  free(serialized);
+
+  napi_value frames;
+  status = napi_create_int32(env, index.nbFrames, &frames);
+  if (status != napi_ok) return nullptr;
+  napi_value duration;
+  status = napi_create_double(env, 1000.0 * index.nbFrames * index.frameSamples / index.sampleRate, &duration);
+  if (status != napi_ok) return nullptr;
+  napi_value samplerate;
+  status = napi_create_int32(env, index.sampleRate, &samplerate);
+  if (status != napi_ok) return nullptr;
+  napi_value channels;
+  status = napi_create_int32(env, index.channels, &channels);
+  if (status != napi_ok) return nullptr;
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "index", buffer);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "frames", frames);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "duration", duration);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "samplerate", samplerate);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "channels", channels);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+// Decode a time range of the MP3 data.
+// arg[0]: mp3data  (uint8array or buffer)
+// arg[1]: start (ms)
+// arg[2]: end (ms)
+// arg[3]: options (optional) { index: the buffer from mp3Index(), preRoll: 50 (frames walked back at most to fill the bit reservoir) }
+//         Without the index, the frame headers are walked from the beginning.
+// return: { pcm (interleaved), samplerate, channels }
+napi_value mp3DecodeRange(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the data buffer.
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok) { throwException(env, "Failed to get the MP3 data buffer."); return nullptr; }
+
+  // -- Get the range.
+  double startMs, endMs;
+  status = napi_get_value_double(env, argv[1], &startMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the start time."); return nullptr; }
+  status = napi_get_value_double(env, argv[2], &endMs);
+  if (status != napi_ok) { throwException(env, "Failed to get the end time."); return nullptr; }
+
+  // -- Get the options.
+  napi_value options = (argc > 3) ? argv[3] : NULL;
+  int32_t preRoll = MP3_PRE_ROLL;
+  if (!getOptionInt32(env, options, "preRoll", &preRoll) || preRoll < 0) { throwException(env, "The preRoll option must be a non-negative number."); return nullptr; }
+
+  Mp3Index index;
+  bool hasIndex = false;
+  napi_valuetype valuetype = napi_undefined;
+  if (options != NULL && napi_typeof(env, options, &valuetype) == napi_ok && valuetype == napi_object &&
+      napi_has_named_property(env, options, "index", &hasIndex) == napi_ok && hasIndex)
+  {
+    napi_value indexvalue;
+    status = napi_get_named_property(env, options, "index", &indexvalue);
+    if (status != napi_ok) { throwException(env, "Failed to get the index."); return nullptr; }
+
+    void* indexdata;
+    size_t szIndex;
+    status = napi_get_buffer_info(env, indexvalue, &indexdata, &szIndex);
+    if (status != napi_ok) { throwException(env, "The index must be a buffer."); return nullptr; }
+    if (deserializeMp3Index((char*)indexdata, szIndex, index) < 0 || index.size != length) { throwException(env, "The index does not match the MP3 data."); return nullptr; }
+  }
+  else
+  {
+    if (buildMp3Index(dataptr, length, MP3_INDEX_STEP, index) < 0) { throwException(env, "Invalid MP3 data."); return nullptr; }
+  }
+
+  // Decode the range.
+  std::vector<mp3d_sample_t> pcm;
+  if (mp3DecodeRange(dataptr, length, index, startMs, endMs, preRoll, pcm) < 0) { throwException(env, "The index does not match the MP3 data."); return nullptr; }
+
+  // Set the return value.
+#ifdef MINIMP3_FLOAT_OUTPUT
+  napi_value pcmarray = createFloatArray(env, pcm);
+#else
+  std::vector<float> samples(pcm.size());
+  for (size_t i=0; i<pcm.size(); i++) samples[i] = 1.0 * ((int) pcm[i]) / 32768;
+  napi_value pcmarray = createFloatArray(env, samples);
+#endif
+  if (pcmarray == nullptr) return nullptr;
+
+  napi_value samplerate;
+  status = napi_create_int32(env, index.sampleRate, &samplerate);
+  if (status != napi_ok) return nullptr;
+  napi_value channels;
+  status = napi_create_int32(env, index.channels, &channels);
+  if (status != napi_ok) return nullptr;
+
+  // Set the named property.
+  status = napi_set_named_property(env, result, "pcm", pcmarray);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "samplerate", samplerate);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, result, "channels", channels);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+static void finalizeMp3Decoder(napi_env env, void* data, void* hint)
+{
+  delete (Mp3Decoder*) data;
+}
+
+// Get the native decoder wrapped by 'this'.
+static Mp3Decoder* unwrapMp3Decoder(napi_env env, napi_callback_info args, size_t* argc, napi_value* argv, napi_value* jsthis)
+{
+  napi_status status = napi_get_cb_info(env, args, argc, argv, jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return NULL; }
+
+  Mp3Decoder* decoder = NULL;
+  status = napi_unwrap(env, *jsthis, (void**)&decoder);
+  if (status != napi_ok) { throwException(env, "Failed to get the MP3 decoder."); return NULL; }
+
+  return decoder;
+}
+
+// Create a streaming MP3 decoder.
+// arg[0]: options (optional) { block: the samples per channel emitted at once, 0 (by default) to emit each frame }
+static napi_value Mp3DecoderConstructor(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_value jsthis;
+  status = napi_get_cb_info(env, args, &argc, argv, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  int32_t block = 0;
+  if (!getOptionInt32(env, (argc > 0) ? argv[0] : NULL, "block", &block) || block < 0) { throwException(env, "The block option must be a non-negative number."); return nullptr; }
+
+  Mp3Decoder* decoder = new Mp3Decoder(block);
+  status = napi_wrap(env, jsthis, decoder, finalizeMp3Decoder, NULL, NULL);
+  if (status != napi_ok) { delete decoder; throwException(env, "Failed to wrap the MP3 decoder."); return nullptr; }
+
+  return jsthis;
+}
+
+// Set the sample rate and the channels once the first frame is decoded.
+static bool setMp3StreamInfo(napi_env env, napi_value jsthis, Mp3Decoder* decoder)
+{
+  napi_value samplerate, channels;
+  if (napi_create_int32(env, decoder->getSampleRate(), &samplerate) != napi_ok) return false;
+  if (napi_set_named_property(env, jsthis, "samplerate", samplerate) != napi_ok) return false;
+  if (napi_create_int32(env, decoder->getChannels(), &channels) != napi_ok) return false;
+  return napi_set_named_property(env, jsthis, "channels", channels) == napi_ok;
+}
+
+// Feed a chunk of the MP3 stream.
+// arg[0]: mp3data (uint8array or buffer, any length)
+// return: the PCM of the blocks completed by this chunk (float32array, interleaved if stereo)
+static napi_value Mp3DecoderProcess(napi_env env, napi_callback_info args)
+{
+  size_t argc = 1;
+  napi_value argv[1];
+  napi_value jsthis;
+  Mp3Decoder* decoder = unwrapMp3Decoder(env, args, &argc, argv, &jsthis);
+  if (decoder == NULL) return nullptr;
+
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_uint8_array) { throwException(env, "Failed to get the MP3 data buffer."); return nullptr; }
+
+  bool isKnown = (decoder->getSampleRate() != 0);
+  std::vector<float> pcm;
+  decoder->process(dataptr, length, pcm);
+
+  if (!isKnown && decoder->getSampleRate() != 0 && !setMp3StreamInfo(env, jsthis, decoder)) return nullptr;
+
+  return createFloatArray(env, pcm);
+}
+
+// End of the stream. The frames left and the last block are emitted, and the decoder could be reused for another stream.
+// return: the PCM left (float32array)
+static napi_value Mp3DecoderFlush(napi_env env, napi_callback_info args)
+{
+  size_t argc = 0;
+  napi_value jsthis;
+  Mp3Decoder* decoder = unwrapMp3Decoder(env, args, &argc, NULL, &jsthis);
+  if (decoder == NULL) return nullptr;
+
+  bool isKnown = (decoder->getSampleRate() != 0);
+  std::vector<float> pcm;
+  decoder->flush(pcm);
+
+  // A stream shorter than the lookahead is only decoded now.
+  if (!isKnown && decoder->getSampleRate() != 0 && !setMp3StreamInfo(env, jsthis, decoder)) return nullptr;
+  decoder->reset();
+
+  return createFloatArray(env, pcm);
+}
+
+// Define the 'Mp3Decoder' class.
+napi_value defineMp3Decoder(napi_env env)
+{
+  napi_property_descriptor properties[] = {
+    { "process", NULL, Mp3DecoderProcess, NULL, NULL, NULL, napi_default, NULL },
+    { "flush", NULL, Mp3DecoderFlush, NULL, NULL, NULL, napi_default, NULL },
+  };
+
+  napi_value constructor;
+  napi_status status = napi_define_class(env, "Mp3Decoder", NAPI_AUTO_LENGTH, Mp3DecoderConstructor, NULL,
+                                         sizeof(properties)/sizeof(properties[0]), properties, &constructor);
+  if (status != napi_ok) return nullptr;
+
+  return constructor;
+}
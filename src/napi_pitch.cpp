@@ -11,59 +11,125 @@
  ************************************************/
 
 #include <stdio.h>
+#include <algorithm>
 #include <cstring>
+#include <string>
 #include <vector>
 
 #include "AudioFile.h"
 #include "pitch_detection.h"
+#include "pitch.h"
+#include "parallel.h"
 
 #include "napi_pitch.h"
 #include "napi_common.h"
 
 
-double computePitchEfficiently(const std::vector<double> &wavData, int32_t sampleRate, const char* methodName)
+double computePitchEfficiently(const std::vector<double> &wavData, int32_t sampleRate, const char* methodName, bool isDecimated = false,
+                               double minF0 = PITCH_MIN_FREQUENCY, double maxF0 = PITCH_MAX_FREQUENCY)
 {
+  // Speech F0 rarely exceeds 500 Hz, so the estimators could run at about 8 kHz.
+  // The lags found at the low rate are then refined on the full-rate frame.
+  int factor = isDecimated ? getDecimationFactor(sampleRate) : 1;
+  std::vector<double> decimated;
+  if (factor > 1) decimated = decimate(wavData, factor);
+  const std::vector<double> &signal = (factor > 1) ? decimated : wavData;
+  int32_t rate = sampleRate / factor;
+
   double sum = 0.0;
   int count = 0;
-  int window = sampleRate/25; // 40 ms per frame.
+  int window = (minF0 > 0) ? getFrameLengthForF0(rate, minF0) : rate/25; // 40 ms per frame, or two periods of the minF0.
   int overlap = window/2; // 20 ms as the overlap.
+  if (window < 2) return -1.0; // The sample rate is too low.
+  if (window > (int)signal.size()) return -1.0; // Shorter than a frame.
 
-  for(size_t i=0; i<wavData.size()-window; i+=overlap)
-  {
-    std::vector<double>::const_iterator first = wavData.begin() + i;
-    std::vector<double>::const_iterator last = wavData.begin() + i + window;
-    std::vector<double> data(first, last);
+  // The lag-based methods only search the lags of [minF0, maxF0].
+  int method = getPitchMethod(methodName);
+  PitchAnalyzer* analyzer = (method != 0) ? new PitchAnalyzer(window, rate, minF0, maxF0) : NULL;
+  std::vector<float> frame(window);
+  double pitches[PITCH_NB_METHODS];
 
+  for(size_t i=0; i+window<signal.size(); i+=overlap)
+  {
     double pitch = -1.0;
-    if ( 0 == strcmp(methodName, "acorr") ) {
-      pitch = get_pitch_autocorrelation(data, sampleRate);
-    } else if( 0 == strcmp(methodName, "yin") ) {
-      pitch = get_pitch_yin(data, sampleRate);
-    } else if( 0 == strcmp(methodName, "mpm") ) {
-      pitch = get_pitch_mpm(data, sampleRate);
-    } else if( 0 == strcmp(methodName, "goertzel") ) {
-      pitch = get_pitch_goertzel(data, sampleRate);
-    } else if( 0 == strcmp(methodName, "dft") ) {
-      pitch = get_pitch_dft(data, sampleRate);
+    if (analyzer != NULL) {
+      for(int k=0; k<window; k++) frame[k] = (float)signal[i+k];
+      analyzer->analyze(frame.data(), method, pitches);
+      pitch = pitches[ (method==PITCH_METHOD_ACORR) ? PITCH_IDX_ACORR : ( (method==PITCH_METHOD_YIN) ? PITCH_IDX_YIN : PITCH_IDX_MPM ) ];
+    } else {
+      std::vector<double>::const_iterator first = signal.begin() + i;
+      std::vector<double>::const_iterator last = signal.begin() + i + window;
+      std::vector<double> data(first, last);
+
+      if( 0 == strcmp(methodName, "goertzel") ) {
+        pitch = get_pitch_goertzel(data, rate);
+      } else if( 0 == strcmp(methodName, "dft") ) {
+        pitch = get_pitch_dft(data, rate);
+      }
+    }
+
+    if(factor > 1 && pitch > 0)
+    {
+      int frameLength = std::min(window*factor, (int)(wavData.size() - i*factor));
+      pitch = refinePitch(wavData.data() + i*factor, frameLength, sampleRate, pitch, factor);
     }
 
-    if(pitch>0 && pitch<1000) // Remove the abnormal points.
+    if(pitch>0 && pitch>=minF0 && pitch<=maxF0) // Remove the abnormal points, and those the refinement moved out of the F0 range.
     {
       sum += pitch;
       count ++;
     }
   }
 
-  // compute the average
-  double mean = sum/count;
+  delete analyzer;
+
+  // compute the average, -1 if no frame is voiced.
+  double mean = (count > 0) ? sum/count : -1.0;
 
   return mean;
 }
 
+struct PitchOptions
+{
+  bool isDecimated = false;
+  double minF0 = PITCH_MIN_FREQUENCY;
+  double maxF0 = PITCH_MAX_FREQUENCY;
+};
+
+// Parse the { decimate, minF0, maxF0 } options. Throws and returns false if they are invalid.
+static bool getPitchOptions(napi_env env, napi_value options, PitchOptions &pitchOptions)
+{
+  if (!getOptionBool(env, options, "decimate", &pitchOptions.isDecimated)) { throwException(env, "The decimate option must be a boolean."); return false; }
+
+  double minF0 = -1.0;
+  double maxF0 = -1.0;
+  if (!getOptionDouble(env, options, "minF0", &minF0)) { throwException(env, "The minF0 option must be a number."); return false; }
+  if (!getOptionDouble(env, options, "maxF0", &maxF0)) { throwException(env, "The maxF0 option must be a number."); return false; }
+  if (minF0 >= 0) pitchOptions.minF0 = minF0;
+  if (maxF0 >= 0) pitchOptions.maxF0 = maxF0;
+  if (pitchOptions.maxF0 <= pitchOptions.minF0) { throwException(env, "The maxF0 must be greater than the minF0."); return false; }
+
+  return true;
+}
+
+// Compute the mean pitch of one mono-channel clip.
+static double computePitchOfClip(const float* data, size_t length, int32_t sampleRate, const char* methodName, const PitchOptions &options)
+{
+  // -- Save the wave data buffer. (Only accepts one channel).
+  std::vector<double> wavData(length); // We only use the first channel or at most the first two channels.
+  for (size_t i=0; i<length; i++) wavData[i] = data[i];
+
+  return computePitchEfficiently(wavData, sampleRate, methodName, options.isDecimated, options.minF0, options.maxF0);
+}
+
 // Detect the pitch from a given mono-channel audio.
 // arg[0]: wavdata (a single channel vector<float>)
 // arg[1]: sample rate
 // arg[2]: method  (available choices: acorr, yin, mpm, goertzel, dft)
+// arg[3]: options (optional) { decimate: false, minF0: 0, maxF0: 1000 }
+//         decimate: run the method at about 8 kHz, then refine the lag at the full rate.
+//         minF0, maxF0: the F0 range in Hz. acorr, yin and mpm only search the lags within it,
+//                       and with a minF0 the frame holds two periods of it instead of 40 ms.
 napi_value detectPitch(napi_env env, napi_callback_info args)
 {
   napi_value result;
@@ -77,8 +143,8 @@ napi_value detectPitch(napi_env env, napi_callback_info args)
   if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
 
   // Parse the input arguments.
-  size_t argc = 3;
-  napi_value argv[3];
+  size_t argc = 4;
+  napi_value argv[4];
   status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
   if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
 
@@ -90,9 +156,6 @@ napi_value detectPitch(napi_env env, napi_callback_info args)
   size_t byte_offset;
   status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
   if (status != napi_ok) { throwException(env, "Failed to create the wave data buffer."); return nullptr; }
-  // -- Save the wave data buffer. (Only accepts one channel).
-  std::vector<double> wavData(length); // We only use the first channel or at most the first two channels.
-  for (size_t i=0; i<length; i++) wavData[i] = data[i];
 
   // -- Get the sample rate.
   int32_t sampleRate;
@@ -105,8 +168,12 @@ napi_value detectPitch(napi_env env, napi_callback_info args)
   status = napi_get_value_string_utf8(env, argv[2], methodName, 128, &lenMethodName);
   if (status != napi_ok) { throwException(env, "Failed to create the wave file name."); return nullptr; }
 
+  // -- Get the options.
+  PitchOptions options;
+  if (!getPitchOptions(env, (argc > 3) ? argv[3] : NULL, options)) return nullptr;
+
   // Compute the pitch.
-  double pitch = computePitchEfficiently(wavData, sampleRate, methodName);
+  double pitch = computePitchOfClip(data, length, sampleRate, methodName, options);
 
   // Set the pitch.
   napi_value retPitch;
@@ -130,3 +197,416 @@ napi_value detectPitch(napi_env env, napi_callback_info args)
   return promise;
 }
 
+
+// Create a Float64Array holding the pitches.
+static napi_value createPitchArray(napi_env env, const std::vector<double> &pitches)
+{
+  napi_status status;
+
+  size_t byte_length = pitches.size()*sizeof(double);
+  napi_value arraybuffer;
+  double* pitchdata = NULL;
+  status = napi_create_arraybuffer(env, byte_length, (void**)&pitchdata, &arraybuffer);
+  if (status != napi_ok) { throwException(env, "Failed to create the pitch buffer."); return nullptr; }
+  if (byte_length > 0) memcpy(pitchdata, pitches.data(), byte_length);
+
+  napi_value pitcharray;
+  status = napi_create_typedarray(env, napi_float64_array, pitches.size(), arraybuffer, 0, &pitcharray);
+  if (status != napi_ok) { throwException(env, "Failed to create the pitch array."); return nullptr; }
+
+  return pitcharray;
+}
+
+
+// Compute the pitch of the clips on a worker thread, each clip on one of the native threads.
+class PitchBatchTask : public AsyncTask
+{
+
+public:
+
+  virtual void execute()
+  {
+    m_pitches.resize(m_clips.size());
+    parallelFor(m_clips.size(), m_nbThreads, [&](size_t i) {
+      m_pitches[i] = computePitchOfClip(m_clips[i], m_lengths[i], m_sampleRate, m_methodName.c_str(), m_options);
+    });
+  };
+
+  virtual napi_value complete(napi_env env)
+  {
+    return createPitchArray(env, m_pitches);
+  };
+
+  // Input: the clips point into the JS arrays, kept alive by keep().
+  std::vector<const float*> m_clips;
+  std::vector<size_t> m_lengths;
+  int32_t m_sampleRate;
+  std::string m_methodName;
+  PitchOptions m_options;
+  int32_t m_nbThreads = 0;
+
+private:
+
+  std::vector<double> m_pitches;
+};
+
+// Detect the pitch of many mono-channel clips in parallel.
+// arg[0]: clips (an array of Float32Array, or one Float32Array holding all the clips back to back)
+// arg[1]: sample rate
+// arg[2]: method  (available choices: acorr, yin, mpm, goertzel, dft)
+// arg[3]: options (optional) { offsets, threads, decimate, minF0, maxF0 }
+//         offsets: the start of each clip in the concatenated Float32Array (array of numbers).
+//         threads: the number of native threads (one per core by default).
+// The clips are read on a worker thread: they must not be changed until the promise is settled.
+// return: pitch  (Float64Array, one mean pitch per clip)
+napi_value detectPitchBatch(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[1], &sampleRate);
+  if (status != napi_ok) { throwException(env, "Failed to create the sample rate variable."); return nullptr; }
+
+  // -- Get the method name.
+  char methodName[128];
+  size_t lenMethodName;
+  status = napi_get_value_string_utf8(env, argv[2], methodName, 128, &lenMethodName);
+  if (status != napi_ok) { throwException(env, "Failed to get the method name."); return nullptr; }
+
+  // -- Get the options.
+  napi_value options = (argc > 3) ? argv[3] : NULL;
+  PitchOptions pitchOptions;
+  if (!getPitchOptions(env, options, pitchOptions)) return nullptr;
+  int32_t nbThreads = 0;
+  if (!getOptionInt32(env, options, "threads", &nbThreads)) { throwException(env, "The threads option must be a number."); return nullptr; }
+
+  // -- Get the clips. They are only pointed to, and kept alive until the promise is settled.
+  std::vector<const float*> clips;
+  std::vector<size_t> lengths;
+  std::vector<napi_value> values;
+  bool isArray = false;
+  status = napi_is_array(env, argv[0], &isArray);
+  if (status != napi_ok) { throwException(env, "Failed to get the clips."); return nullptr; }
+  if (isArray)
+  {
+    uint32_t nbClips = 0;
+    status = napi_get_array_length(env, argv[0], &nbClips);
+    if (status != napi_ok) { throwException(env, "Failed to get the number of clips."); return nullptr; }
+
+    for (uint32_t i=0; i<nbClips; i++)
+    {
+      napi_value clip;
+      status = napi_get_element(env, argv[0], i, &clip);
+      if (status != napi_ok) { throwException(env, "Failed to get the clip."); return nullptr; }
+
+      float* data;
+      napi_typedarray_type type;
+      size_t length;
+      napi_value arraybuffer;
+      size_t byte_offset;
+      status = napi_get_typedarray_info(env, clip, &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+      if (status != napi_ok || type != napi_float32_array) { throwException(env, "Each clip must be a Float32Array."); return nullptr; }
+      values.push_back(clip);
+      clips.push_back(data);
+      lengths.push_back(length);
+    }
+  }
+  else
+  {
+    float* data;
+    napi_typedarray_type type;
+    size_t length;
+    napi_value arraybuffer;
+    size_t byte_offset;
+    status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+    if (status != napi_ok || type != napi_float32_array) { throwException(env, "The clips must be an array or a Float32Array."); return nullptr; }
+    values.push_back(argv[0]);
+
+    napi_value offsets = NULL;
+    bool hasOffsets = false;
+    napi_valuetype valuetype = napi_undefined;
+    if (options != NULL && napi_typeof(env, options, &valuetype) == napi_ok && valuetype == napi_object &&
+        napi_has_named_property(env, options, "offsets", &hasOffsets) == napi_ok && hasOffsets)
+    {
+      status = napi_get_named_property(env, options, "offsets", &offsets);
+      if (status != napi_ok) { throwException(env, "Failed to get the offsets."); return nullptr; }
+    }
+
+    if (offsets == NULL)
+    {
+      // A single clip.
+      clips.push_back(data);
+      lengths.push_back(length);
+    }
+    else
+    {
+      uint32_t nbClips = 0;
+      status = napi_get_array_length(env, offsets, &nbClips);
+      if (status != napi_ok) { throwException(env, "The offsets must be an array."); return nullptr; }
+
+      std::vector<int64_t> starts(nbClips + 1, length);
+      for (uint32_t i=0; i<nbClips; i++)
+      {
+        napi_value offset;
+        status = napi_get_element(env, offsets, i, &offset);
+        if (status == napi_ok) status = napi_get_value_int64(env, offset, &starts[i]);
+        if (status != napi_ok) { throwException(env, "Failed to get the offset."); return nullptr; }
+      }
+      for (uint32_t i=0; i<nbClips; i++)
+      {
+        if (starts[i] < 0 || starts[i] > starts[i+1]) { throwException(env, "The offsets must be increasing and within the buffer."); return nullptr; }
+        clips.push_back(data + starts[i]);
+        lengths.push_back(starts[i+1] - starts[i]);
+      }
+    }
+  }
+
+  // Compute the pitch of each clip, on a worker thread.
+  PitchBatchTask* task = new PitchBatchTask();
+  task->m_clips = clips;
+  task->m_lengths = lengths;
+  task->m_sampleRate = sampleRate;
+  task->m_methodName = methodName;
+  task->m_options = pitchOptions;
+  task->m_nbThreads = nbThreads;
+  for (size_t i=0; i<values.size(); i++) task->keep(env, values[i]);
+
+  return queueAsyncTask(env, "detectPitchBatch", task);
+}
+
+// Detect the pitch with several methods in one pass over the mono-channel audio.
+// arg[0]: wavdata (a single channel vector<float>)
+// arg[1]: sample rate
+// arg[2]: methods (optional, an array of: acorr, yin, mpm. All of them by default)
+// arg[3]: options (optional) { minF0: 0, maxF0: 1000 }, the F0 search range in Hz.
+// return: { acorr, yin, mpm, pitch } where 'pitch' is the fused one, -1 if no frame is voiced.
+//         NOTE: The kernels are not those of detectPitch(), so the values differ from it.
+napi_value detectPitchEnsemble(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Parse the input arguments.
+  size_t argc = 4;
+  napi_value argv[4];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the wave data buffer. (Only accepts one channel).
+  float* data;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+  if (status != napi_ok) { throwException(env, "Failed to create the wave data buffer."); return nullptr; }
+
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[1], &sampleRate);
+  if (status != napi_ok) { throwException(env, "Failed to create the sample rate variable."); return nullptr; }
+
+  // -- Get the methods.
+  int methods = PITCH_METHOD_ALL;
+  bool isArray = false;
+  if (argc > 2 && napi_is_array(env, argv[2], &isArray) == napi_ok && isArray)
+  {
+    uint32_t nbMethods = 0;
+    status = napi_get_array_length(env, argv[2], &nbMethods);
+    if (status != napi_ok) { throwException(env, "Failed to get the number of methods."); return nullptr; }
+
+    methods = 0;
+    for (uint32_t i=0; i<nbMethods; i++)
+    {
+      napi_value element;
+      status = napi_get_element(env, argv[2], i, &element);
+      if (status != napi_ok) { throwException(env, "Failed to get the method."); return nullptr; }
+
+      char methodName[128];
+      size_t lenMethodName;
+      status = napi_get_value_string_utf8(env, element, methodName, 128, &lenMethodName);
+      if (status != napi_ok) { throwException(env, "Failed to get the method name."); return nullptr; }
+
+      int method = getPitchMethod(methodName);
+      if (method == 0) { throwException(env, "Unsupported method, the choices are: acorr, yin, mpm."); return nullptr; }
+      methods |= method;
+    }
+  }
+
+  // -- Get the options.
+  napi_value options = (argc > 3) ? argv[3] : NULL;
+  double minF0 = PITCH_MIN_FREQUENCY;
+  double maxF0 = PITCH_MAX_FREQUENCY;
+  if (!getOptionDouble(env, options, "minF0", &minF0)) { throwException(env, "The minF0 option must be a number."); return nullptr; }
+  if (!getOptionDouble(env, options, "maxF0", &maxF0)) { throwException(env, "The maxF0 option must be a number."); return nullptr; }
+  if (minF0 < 0 || maxF0 <= minF0) { throwException(env, "Invalid F0 search range."); return nullptr; }
+  if (getEnsembleFrameLength(sampleRate, minF0) < 2) { throwException(env, "The sample rate is too low for a pitch frame."); return nullptr; }
+
+  // Compute the pitch.
+  PitchEnsemble ensemble = computePitchEnsemble(data, length, sampleRate, methods, minF0, maxF0);
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) { throwException(env, "Failed to create the resulting object."); return nullptr; }
+
+  // Set the pitches.
+  const char* names[PITCH_NB_METHODS] = {"acorr", "yin", "mpm"};
+  napi_value retPitch;
+  for (int i=0; i<PITCH_NB_METHODS; i++)
+  {
+    if ( !(methods & (1 << i)) ) continue;
+
+    status = napi_create_double(env, ensemble.pitches[i], &retPitch);
+    if (status != napi_ok) { throwException(env, "Failed to create the pitch variable."); return nullptr; }
+    status = napi_set_named_property(env, result, names[i], retPitch);
+    if (status != napi_ok) { throwException(env, "Failed to set the pitch to the resulting object."); return nullptr; }
+  }
+
+  status = napi_create_double(env, ensemble.pitch, &retPitch);
+  if (status != napi_ok) { throwException(env, "Failed to create the pitch variable."); return nullptr; }
+  status = napi_set_named_property(env, result, "pitch", retPitch);
+  if (status != napi_ok) { throwException(env, "Failed to set the pitch to the resulting object."); return nullptr; }
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
+
+
+static void finalizePitchTracker(napi_env env, void* data, void* hint)
+{
+  delete (PitchTracker*) data;
+}
+
+// Get the native tracker wrapped by 'this'.
+static PitchTracker* unwrapPitchTracker(napi_env env, napi_callback_info args, size_t* argc, napi_value* argv)
+{
+  napi_value jsthis;
+  napi_status status = napi_get_cb_info(env, args, argc, argv, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return NULL; }
+
+  PitchTracker* tracker = NULL;
+  status = napi_unwrap(env, jsthis, (void**)&tracker);
+  if (status != napi_ok) { throwException(env, "Failed to get the pitch tracker."); return NULL; }
+
+  return tracker;
+}
+
+// Create a streaming pitch tracker.
+// arg[0]: sample rate
+// arg[1]: options (optional) { frame: 40 (ms), hop: 10 (ms), lookahead: 2 (frames) }
+//         The hop could exceed the frame: the samples between two frames are skipped.
+static napi_value PitchTrackerConstructor(napi_env env, napi_callback_info args)
+{
+  napi_status status;
+
+  size_t argc = 2;
+  napi_value argv[2];
+  napi_value jsthis;
+  status = napi_get_cb_info(env, args, &argc, argv, &jsthis, NULL);
+  if (status != napi_ok) { throwException(env, "Failed to parse the arguments."); return nullptr; }
+
+  // -- Get the sample rate.
+  int32_t sampleRate;
+  status = napi_get_value_int32(env, argv[0], &sampleRate);
+  if (status != napi_ok || sampleRate <= 0) { throwException(env, "Failed to create the sample rate variable."); return nullptr; }
+
+  // -- Get the options.
+  int32_t options[3] = {40, 10, 2};
+  const char* names[3] = {"frame", "hop", "lookahead"};
+  for (int i=0; i<3; i++)
+  {
+    if (!getOptionInt32(env, (argc > 1) ? argv[1] : NULL, names[i], &options[i])) { throwException(env, "Failed to get the option value."); return nullptr; }
+  }
+  if (options[0] <= 0 || options[1] <= 0 ||
+      PitchTracker::getTrackerLength(sampleRate, options[0]) < 2 || PitchTracker::getTrackerLength(sampleRate, options[1]) < 1)
+  {
+    throwException(env, "Invalid frame or hop length: the frame must hold at least 2 samples and the hop 1.");
+    return nullptr;
+  }
+
+  PitchTracker* tracker = new PitchTracker(sampleRate, options[0], options[1], options[2]);
+  status = napi_wrap(env, jsthis, tracker, finalizePitchTracker, NULL, NULL);
+  if (status != napi_ok) { delete tracker; throwException(env, "Failed to wrap the pitch tracker."); return nullptr; }
+
+  // Set the latency, in ms.
+  napi_value latency;
+  status = napi_create_double(env, tracker->getLatencyMs(), &latency);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, jsthis, "latency", latency);
+  if (status != napi_ok) return nullptr;
+
+  return jsthis;
+}
+
+// Feed a chunk of audio.
+// arg[0]: wavdata (a single channel Float32Array, any length)
+// return: the pitches emitted by this chunk (Float64Array, one per hop, -1 if unvoiced)
+static napi_value PitchTrackerProcess(napi_env env, napi_callback_info args)
+{
+  size_t argc = 1;
+  napi_value argv[1];
+  PitchTracker* tracker = unwrapPitchTracker(env, args, &argc, argv);
+  if (tracker == NULL) return nullptr;
+
+  float* data;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  napi_status status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &data, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_float32_array) { throwException(env, "Failed to get the wave data buffer."); return nullptr; }
+
+  std::vector<double> pitches;
+  tracker->process(data, length, pitches);
+
+  return createPitchArray(env, pitches);
+}
+
+// End of the stream.
+// return: the pitches still waiting for their lookahead (Float64Array)
+static napi_value PitchTrackerFlush(napi_env env, napi_callback_info args)
+{
+  size_t argc = 0;
+  PitchTracker* tracker = unwrapPitchTracker(env, args, &argc, NULL);
+  if (tracker == NULL) return nullptr;
+
+  std::vector<double> pitches;
+  tracker->flush(pitches);
+
+  return createPitchArray(env, pitches);
+}
+
+// Define the 'PitchTracker' class.
+napi_value definePitchTracker(napi_env env)
+{
+  napi_property_descriptor properties[] = {
+    { "process", NULL, PitchTrackerProcess, NULL, NULL, NULL, napi_default, NULL },
+    { "flush", NULL, PitchTrackerFlush, NULL, NULL, NULL, napi_default, NULL },
+  };
+
+  napi_value constructor;
+  napi_status status = napi_define_class(env, "PitchTracker", NAPI_AUTO_LENGTH, PitchTrackerConstructor, NULL,
+                                         sizeof(properties)/sizeof(properties[0]), properties, &constructor);
+  if (status != napi_ok) return nullptr;
+
+  return constructor;
+}
@@ -0,0 +1,142 @@
+/*************************************************
+ *
+ * Probe the AMR and MP3 data without decoding.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-19
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#include <stdio.h>
+
+#include "amr.h"
+#include "minimp3.h"
+
+#include "napi_probe.h"
+#include "napi_common.h"
+
+
+// Set a number property of the object.
+static bool setNumber(napi_env env, napi_value object, const char* name, double number)
+{
+  napi_value value;
+  if (napi_create_double(env, number, &value) != napi_ok) return false;
+  return napi_set_named_property(env, object, name, value) == napi_ok;
+}
+
+// Set a string property of the object.
+static bool setString(napi_env env, napi_value object, const char* name, const char* string)
+{
+  napi_value value;
+  if (napi_create_string_utf8(env, string, NAPI_AUTO_LENGTH, &value) != napi_ok) return false;
+  return napi_set_named_property(env, object, name, value) == napi_ok;
+}
+
+// Set an object property counting the frames per key, for the non-zero counts only.
+static bool setHistogram(napi_env env, napi_value object, const char* name, const unsigned* keys, const double* counts, int size)
+{
+  napi_value histogram;
+  if (napi_create_object(env, &histogram) != napi_ok) return false;
+  for (int i=0; i<size; i++)
+  {
+    if (counts[i] == 0) continue;
+    char key[16];
+    snprintf(key, sizeof(key), "%u", keys[i]);
+    if (!setNumber(env, histogram, key, counts[i])) return false;
+  }
+  return napi_set_named_property(env, object, name, histogram) == napi_ok;
+}
+
+static bool probeAMRData(napi_env env, char* data, int size, napi_value result)
+{
+  AmrProbe amr;
+  if (probeAMR(data, size, amr) < 0) return false;
+
+  unsigned frameTypes[16];
+  double counts[16];
+  for (int i=0; i<16; i++) { frameTypes[i] = i; counts[i] = amr.frameTypes[i]; }
+
+  return setString(env, result, "format", (amr.type==AMR_NB) ? "amr-nb" : "amr-wb")
+      && setNumber(env, result, "samplerate", amr.sampleRate)
+      && setNumber(env, result, "channels", 1)
+      && setNumber(env, result, "frames", amr.nbFrames)
+      && setNumber(env, result, "duration", amr.durationMs)
+      && setHistogram(env, result, "modes", frameTypes, counts, 16);
+}
+
+static bool probeMP3Data(napi_env env, const uint8_t* data, size_t size, napi_value result)
+{
+  mp3dec_probe_info_t mp3;
+  if (mp3dec_probe_buf(data, size, &mp3) < 0) return false;
+
+  double counts[16];
+  for (int i=0; i<16; i++) counts[i] = mp3.bitrate_frames[i];
+
+  const char* tags[] = { "none", "xing", "vbri" };
+  return setString(env, result, "format", "mp3")
+      && setNumber(env, result, "samplerate", mp3.hz)
+      && setNumber(env, result, "channels", mp3.channels)
+      && setNumber(env, result, "layer", mp3.layer)
+      && setNumber(env, result, "frames", mp3.frames)
+      && setNumber(env, result, "duration", 1000.0 * mp3.samples / mp3.hz)
+      && setHistogram(env, result, "bitrates", mp3.bitrate_kbps, counts, 16)
+      && setString(env, result, "vbrTag", tags[mp3.vbr_tag])
+      && setNumber(env, result, "tagFrames", mp3.tag_frames);
+}
+
+// Get the format, duration, frame count, mode/bit rate histogram and sample rate of the AMR or MP3 data.
+// Only the frame headers are read: there is no PCM output and no codec.
+// arg[0]: data  (uint8array or buffer)
+// return: { format: 'amr-nb', 'amr-wb' or 'mp3', samplerate, channels, frames, duration (ms),
+//           modes (AMR): { frame type: frames }, bitrates (MP3): { kbps: frames },
+//           layer, vbrTag: 'none', 'xing' or 'vbri', tagFrames (MP3): the frame count of the VBR tag, 0 if unknown }
+napi_value probe(napi_env env, napi_callback_info args)
+{
+  napi_value result;
+  napi_deferred deferred;
+  napi_value promise;
+
+  napi_status status;
+
+  // Create the promise.
+  status = napi_create_promise(env, &deferred, &promise);
+  if (status != napi_ok) { throwException(env, "Failed to create the promise object."); return nullptr; }
+
+  // Create the resulting object.
+  status = napi_create_object(env, &result);
+  if (status != napi_ok) return nullptr;
+
+  // Parse the input arguments.
+  size_t argc = 1;
+  napi_value argv[1];
+  status = napi_get_cb_info(env, args, &argc, argv, NULL, NULL);
+  if (status != napi_ok || argc < 1) { throwException(env, "Expect the data to probe."); return nullptr; }
+
+  // -- Get the data buffer.
+  uint8_t* dataptr;
+  napi_typedarray_type type;
+  size_t length;
+  napi_value arraybuffer;
+  size_t byte_offset;
+  status = napi_get_typedarray_info(env, argv[0], &type, &length, (void**) &dataptr, &arraybuffer, &byte_offset);
+  if (status != napi_ok || type != napi_uint8_array) { throwException(env, "Failed to get the data buffer."); return nullptr; }
+
+  // AMR has a magic header, so it is checked first.
+  if (getAMRType((char*)dataptr, length) != AMR_UNKNOWN) {
+    if (!probeAMRData(env, (char*)dataptr, length, result)) { throwException(env, "Failed to probe the AMR data."); return nullptr; }
+  } else if (!probeMP3Data(env, dataptr, length, result)) {
+    throwException(env, "Unknown format: neither AMR nor MP3.");
+    return nullptr;
+  }
+
+  status = napi_resolve_deferred(env, deferred, result);
+  if (status != napi_ok) { throwException(env, "Failed to set the deferred result."); return nullptr; }
+
+  // At this point the deferred has been freed, so we should assign NULL to it.
+  deferred = NULL;
+
+  return promise;
+}
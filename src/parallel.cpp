@@ -0,0 +1,148 @@
+/*************************************************
+ *
+ * Run independent tasks on several threads.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-18
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ ************************************************/
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+
+// The worker threads, started on demand and kept for the next calls.
+// NOTE: The pool is never destroyed: its threads wait for jobs until the process exits.
+class WorkerPool
+{
+
+public:
+
+  // Start more workers if there are less than 'nbWorkers'.
+  void reserve(int nbWorkers)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while ((int)m_threads.size() < nbWorkers) m_threads.push_back(std::thread(&WorkerPool::run, this));
+  }
+
+  void submit(const std::function<void()> &job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.push_back(job);
+    }
+    m_ready.notify_one();
+  }
+
+private:
+
+  void run()
+  {
+    for (;;)
+    {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this]() { return !m_jobs.empty(); });
+        job = m_jobs.front();
+        m_jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+private:
+
+  std::mutex m_mutex;
+  std::condition_variable m_ready;
+  std::deque<std::function<void()>> m_jobs;
+  std::vector<std::thread> m_threads;
+};
+
+static WorkerPool* getWorkerPool()
+{
+  static WorkerPool* pool = new WorkerPool();
+  return pool;
+}
+
+
+// The state of one parallelFor() call, shared with its helper jobs.
+// A helper which starts after the call is over (all the tasks done by the others) returns at once,
+// so the call only waits for the helpers which are running, never for those still queued.
+struct ParallelLoop
+{
+  ParallelLoop(size_t count, const std::function<void(size_t)>* task) : next(0), count(count), task(task) {}
+
+  void work()
+  {
+    for (size_t i = next++; i < count; i = next++) (*task)(i);
+  }
+
+  void help()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (isClosed) return;
+      nbRunning++;
+    }
+    work();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      nbRunning--;
+    }
+    done.notify_all();
+  }
+
+  // Called once the calling thread ran out of tasks.
+  void close()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    isClosed = true;
+    done.wait(lock, [this]() { return nbRunning == 0; });
+  }
+
+  std::atomic<size_t> next;
+  size_t count;
+  const std::function<void(size_t)>* task; // only used while the call is not over.
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int nbRunning = 0;
+  bool isClosed = false;
+};
+
+
+int getThreadCount()
+{
+  unsigned int count = std::thread::hardware_concurrency();
+  return (count > 0) ? count : 1;
+}
+
+void parallelFor(size_t count, int nbThreads, const std::function<void(size_t)> &task)
+{
+  if (nbThreads <= 0) nbThreads = getThreadCount();
+  if ((size_t)nbThreads > count) nbThreads = count;
+  if (nbThreads <= 1)
+  {
+    for (size_t i=0; i<count; i++) task(i);
+    return;
+  }
+
+  // The calling thread is one of the workers, the pool gives the others.
+  std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>(count, &task);
+  WorkerPool* pool = getWorkerPool();
+  pool->reserve(nbThreads - 1);
+  for (int i=1; i<nbThreads; i++) pool->submit([loop]() { loop->help(); });
+  loop->work();
+  loop->close();
+}
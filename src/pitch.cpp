@@ -0,0 +1,548 @@
+/*************************************************
+ *
+ * Pitch estimation on a shared autocorrelation.
+ *
+ * Author: Feng Zhang (zhjinf@gmail.com)
+ * Date: 2026-10-18
+ *
+ * Copyright:
+ *   See LICENSE.
+ *
+ * The autocorrelation r(tau) of each frame is computed once with the FFT.
+ * Together with the energy prefix sums e(k), it gives:
+ *   - acorr: the highest peak of r(tau)/r(0);
+ *   - yin:   the difference d(tau) = e(N-tau) + e(N) - e(tau) - 2r(tau);
+ *   - mpm:   the NSDF n(tau) = 2r(tau) / (e(N-tau) + e(N) - e(tau)).
+ *
+ ************************************************/
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include "pitch.h"
+
+
+#define YIN_THRESHOLD       (0.15)
+#define MPM_CUTOFF          (0.93)
+#define ACORR_MIN_PEAK      (0.3)
+
+// The Viterbi costs of the tracker.
+#define TRACKER_VOICING_THRESHOLD  (0.6)   // the clarity above which a frame looks voiced.
+#define TRACKER_OCTAVE_COST        (2.0)   // the cost per octave of F0 jump between frames.
+#define TRACKER_VOICING_COST       (0.5)   // the cost to switch between voiced and unvoiced.
+
+
+int getPitchMethod(const char* methodName)
+{
+  if ( 0 == strcmp(methodName, "acorr") ) return PITCH_METHOD_ACORR;
+  if ( 0 == strcmp(methodName, "yin") ) return PITCH_METHOD_YIN;
+  if ( 0 == strcmp(methodName, "mpm") ) return PITCH_METHOD_MPM;
+  return 0;
+}
+
+int getFrameLengthForF0(int sampleRate, double minF0)
+{
+  double period = std::ceil(sampleRate / minF0);
+  return (period < INT_MAX / 4) ? 2 * (int)period + 2 : INT_MAX / 2; // too long for any clip.
+}
+
+int getEnsembleFrameLength(int sampleRate, double minF0)
+{
+  if (sampleRate <= 0) return 0;
+  return (minF0 > 0) ? getFrameLengthForF0(sampleRate, minF0) : sampleRate/25; // 40 ms per frame by default.
+}
+
+PitchAnalyzer::PitchAnalyzer(int frameLength, int sampleRate, double minF0, double maxF0)
+{
+  m_frameLength = frameLength;
+  m_sampleRate = sampleRate;
+  m_minF0 = minF0;
+  m_maxF0 = maxF0;
+
+  // Zero-pad to at least twice the frame length, so that the circular correlation does not wrap around.
+  m_fftSize = 1;
+  while(m_fftSize < 2 * frameLength) m_fftSize *= 2;
+
+  // The lags out of [minF0, maxF0] are never searched.
+  m_minLag = std::max(2, (int)std::floor(sampleRate / maxF0));
+  m_maxLag = frameLength / 2;
+  if (minF0 > 0) m_maxLag = std::min(m_maxLag, (int)std::ceil(sampleRate / minF0));
+
+  m_fftForward = ffts_init_1d(m_fftSize, FFTS_FORWARD);
+  m_fftBackward = ffts_init_1d(m_fftSize, FFTS_BACKWARD);
+
+  m_signal.resize(m_fftSize);
+  m_spectrum.resize(m_fftSize);
+  m_acf.resize(m_maxLag + 2);
+  m_energy.resize(frameLength + 1);
+  m_work.resize(m_maxLag + 2);
+}
+
+PitchAnalyzer::~PitchAnalyzer()
+{
+  if(m_fftForward)
+  {
+    ffts_free(m_fftForward);
+    m_fftForward = NULL;
+  }
+
+  if(m_fftBackward)
+  {
+    ffts_free(m_fftBackward);
+    m_fftBackward = NULL;
+  }
+}
+
+void PitchAnalyzer::computeAutocorrelation(const float* frame)
+{
+  m_energy[0] = 0.0;
+  for(int i=0; i<m_frameLength; i++)
+  {
+    m_signal[i] = {frame[i], 0.0};
+    m_energy[i+1] = m_energy[i] + (double)frame[i] * frame[i];
+  }
+  for(int i=m_frameLength; i<m_fftSize; i++) m_signal[i] = {0.0, 0.0};
+
+  // r = IFFT(|FFT(x)|^2)
+  ffts_execute(m_fftForward, m_signal.data(), m_spectrum.data());
+  for(int i=0; i<m_fftSize; i++) m_spectrum[i] = {std::norm(m_spectrum[i]), 0.0};
+  ffts_execute(m_fftBackward, m_spectrum.data(), m_signal.data());
+
+  for(int tau=0; tau<m_maxLag+2; tau++) m_acf[tau] = m_signal[tau].real() / m_fftSize; // Must divide the value by its length.
+}
+
+double PitchAnalyzer::parabolicLag(const std::vector<double> &values, int tau)
+{
+  if (tau < 1 || tau + 1 >= (int)values.size()) return tau;
+
+  double s0 = values[tau-1];
+  double s1 = values[tau];
+  double s2 = values[tau+1];
+  double denominator = s0 - 2 * s1 + s2;
+  if (denominator == 0) return tau;
+
+  return tau + 0.5 * (s0 - s2) / denominator;
+}
+
+double PitchAnalyzer::lagToPitch(double lag)
+{
+  double pitch = m_sampleRate / lag;
+  return (pitch >= m_minF0 && pitch <= m_maxF0) ? pitch : -1.0;
+}
+
+double PitchAnalyzer::pitchAutocorrelation()
+{
+  // Skip the main lobe around tau = 0, then take the highest peak.
+  int tau = 1;
+  while(tau < m_maxLag && m_acf[tau] > 0) tau++;
+  tau = std::max(tau, m_minLag);
+
+  int best = -1;
+  for(; tau<=m_maxLag; tau++)
+  {
+    if (best < 0 || m_acf[tau] > m_acf[best]) best = tau;
+  }
+  if (best < 0 || m_acf[best] < ACORR_MIN_PEAK * m_acf[0]) return -1.0;
+
+  return lagToPitch(parabolicLag(m_acf, best));
+}
+
+double PitchAnalyzer::pitchYin()
+{
+  // Cumulative mean normalized difference. The difference is divided by the overlap length,
+  // otherwise the shrinking overlap of the long lags would favour the sub-harmonics.
+  std::vector<double> &cmnd = m_work;
+  double runningSum = 0.0;
+  cmnd[0] = 1.0;
+  for(int tau=1; tau<m_maxLag+2; tau++)
+  {
+    double m = m_energy[m_frameLength - tau] + m_energy[m_frameLength] - m_energy[tau];
+    double d = std::max(0.0, m - 2 * m_acf[tau]) / (m_frameLength - tau);
+    runningSum += d;
+    cmnd[tau] = (runningSum > 0) ? d * tau / runningSum : 1.0;
+  }
+
+  for(int tau=m_minLag; tau<=m_maxLag; tau++)
+  {
+    if (cmnd[tau] < YIN_THRESHOLD)
+    {
+      while(tau + 1 <= m_maxLag && cmnd[tau+1] < cmnd[tau]) tau++;
+      return lagToPitch(parabolicLag(cmnd, tau));
+    }
+  }
+
+  return -1.0;
+}
+
+void PitchAnalyzer::computeNsdf()
+{
+  std::vector<double> &nsdf = m_work;
+  for(int tau=0; tau<m_maxLag+2; tau++)
+  {
+    double m = m_energy[m_frameLength - tau] + m_energy[m_frameLength] - m_energy[tau];
+    nsdf[tau] = (m > 0) ? 2 * m_acf[tau] / m : 0.0;
+  }
+}
+
+void PitchAnalyzer::findKeyMaxima(std::vector<int> &maxima)
+{
+  const std::vector<double> &nsdf = m_work;
+
+  // The key maxima: the highest point between each pair of positive-going and negative-going zero crossings.
+  maxima.clear();
+  int tau = 1;
+  while(tau < m_maxLag && nsdf[tau] > 0) tau++;
+  while(tau < m_maxLag && nsdf[tau] <= 0) tau++;
+
+  int current = -1;
+  for(; tau<=m_maxLag; tau++)
+  {
+    if (nsdf[tau] > 0)
+    {
+      if (current < 0 || nsdf[tau] > nsdf[current]) current = tau;
+    }
+    else if (current >= 0)
+    {
+      if (current >= m_minLag) maxima.push_back(current);
+      current = -1;
+    }
+  }
+  if (current >= m_minLag) maxima.push_back(current);
+}
+
+double PitchAnalyzer::pitchMpm()
+{
+  computeNsdf();
+  findKeyMaxima(m_maxima);
+  if (m_maxima.empty()) return -1.0;
+
+  const std::vector<double> &nsdf = m_work;
+  double highest = 0.0;
+  for(size_t i=0; i<m_maxima.size(); i++) highest = std::max(highest, nsdf[m_maxima[i]]);
+
+  for(size_t i=0; i<m_maxima.size(); i++)
+  {
+    if (nsdf[m_maxima[i]] >= MPM_CUTOFF * highest)
+    {
+      return lagToPitch(parabolicLag(nsdf, m_maxima[i]));
+    }
+  }
+
+  return -1.0;
+}
+
+void PitchAnalyzer::getCandidates(const float* frame, std::vector<PitchCandidate> &candidates)
+{
+  candidates.clear();
+
+  computeAutocorrelation(frame);
+  if (m_acf[0] <= 0) return; // silence
+
+  computeNsdf();
+  findKeyMaxima(m_maxima);
+
+  const std::vector<double> &nsdf = m_work;
+  double highest = 0.0;
+  for(size_t i=0; i<m_maxima.size(); i++) highest = std::max(highest, nsdf[m_maxima[i]]);
+
+  // Periodic frames are almost as clear at every multiple of the period, so
+  // stop at the MPM key maximum: longer lags are only sub-harmonics.
+  for(size_t i=0; i<m_maxima.size(); i++)
+  {
+    double pitch = lagToPitch(parabolicLag(nsdf, m_maxima[i]));
+    if (pitch > 0) candidates.push_back({ pitch, std::min(1.0, nsdf[m_maxima[i]]) });
+    if (nsdf[m_maxima[i]] >= MPM_CUTOFF * highest) break;
+  }
+}
+
+void PitchAnalyzer::analyze(const float* frame, int methods, double* pitches)
+{
+  for(int i=0; i<PITCH_NB_METHODS; i++) pitches[i] = -1.0;
+
+  computeAutocorrelation(frame);
+  if (m_acf[0] <= 0) return; // silence
+
+  if (methods & PITCH_METHOD_ACORR) pitches[PITCH_IDX_ACORR] = pitchAutocorrelation();
+  if (methods & PITCH_METHOD_YIN) pitches[PITCH_IDX_YIN] = pitchYin();
+  if (methods & PITCH_METHOD_MPM) pitches[PITCH_IDX_MPM] = pitchMpm();
+}
+
+double PitchAnalyzer::fuse(const double* pitches)
+{
+  // Insertion sort of the voiced estimates.
+  double voiced[PITCH_NB_METHODS];
+  int count = 0;
+  for(int i=0; i<PITCH_NB_METHODS; i++)
+  {
+    if ( !(pitches[i] > 0) ) continue;
+    int j = count++;
+    for(; j>0 && voiced[j-1]>pitches[i]; j--) voiced[j] = voiced[j-1];
+    voiced[j] = pitches[i];
+  }
+  if (count == 0) return -1.0;
+
+  return (count % 2) ? voiced[count/2] : 0.5 * (voiced[count/2 - 1] + voiced[count/2]);
+}
+
+PitchEnsemble computePitchEnsemble(const float* wavData, size_t length, int sampleRate, int methods, double minF0, double maxF0)
+{
+  PitchEnsemble ensemble;
+  for(int j=0; j<PITCH_NB_METHODS; j++) ensemble.pitches[j] = -1.0;
+  ensemble.pitch = -1.0;
+
+  int window = getEnsembleFrameLength(sampleRate, minF0);
+  if (window < 2 || (size_t)window >= length) return ensemble; // not even one frame.
+  int overlap = window/2; // half of the frame as the overlap.
+
+  double sums[PITCH_NB_METHODS + 1] = {0.0, };
+  int counts[PITCH_NB_METHODS + 1] = {0, };
+
+  PitchAnalyzer analyzer(window, sampleRate, minF0, maxF0);
+  double pitches[PITCH_NB_METHODS];
+  for(size_t i=0; i+window<length; i+=overlap)
+  {
+    analyzer.analyze(wavData + i, methods, pitches);
+
+    for(int j=0; j<PITCH_NB_METHODS; j++)
+    {
+      if(pitches[j]>0) // The analyzer already removed the abnormal points.
+      {
+        sums[j] += pitches[j];
+        counts[j] ++;
+      }
+    }
+
+    double fused = PitchAnalyzer::fuse(pitches);
+    if (fused > 0)
+    {
+      sums[PITCH_NB_METHODS] += fused;
+      counts[PITCH_NB_METHODS] ++;
+    }
+  }
+
+  // compute the average, -1 if no frame is voiced.
+  for(int j=0; j<PITCH_NB_METHODS; j++)
+  {
+    if ( (methods & (1 << j)) && counts[j] > 0 ) ensemble.pitches[j] = sums[j]/counts[j];
+  }
+  if (counts[PITCH_NB_METHODS] > 0) ensemble.pitch = sums[PITCH_NB_METHODS]/counts[PITCH_NB_METHODS];
+
+  return ensemble;
+}
+
+int getDecimationFactor(int sampleRate, int targetRate)
+{
+  return std::max(1, sampleRate / targetRate);
+}
+
+std::vector<double> decimate(const std::vector<double> &data, int factor)
+{
+  if (factor <= 1) return data;
+
+  // Windowed-sinc low-pass, cut off a bit below the new Nyquist frequency.
+  int halfLength = 4 * factor;
+  double cutoff = 0.45 / factor; // cycles per sample
+  std::vector<double> coeffs(2 * halfLength + 1);
+  double sum = 0.0;
+  for(int i=-halfLength; i<=halfLength; i++)
+  {
+    double sinc = (i == 0) ? 2 * cutoff : std::sin(2 * M_PI * cutoff * i) / (M_PI * i);
+    double window = 0.54 + 0.46 * std::cos(M_PI * i / halfLength); // Hamming
+    coeffs[i + halfLength] = sinc * window;
+    sum += coeffs[i + halfLength];
+  }
+  for(size_t i=0; i<coeffs.size(); i++) coeffs[i] /= sum; // unit gain at DC
+
+  size_t length = data.size();
+  std::vector<double> decimated(length / factor);
+  for(size_t k=0; k<decimated.size(); k++)
+  {
+    long center = (long)(k * factor);
+    double y = 0.0;
+    if (center >= halfLength && center + halfLength < (long)length)
+    {
+      const double* x = data.data() + center - halfLength;
+      for(size_t j=0; j<coeffs.size(); j++) y += coeffs[j] * x[j];
+    }
+    else
+    {
+      // Zero-padding at both ends.
+      for(int j=-halfLength; j<=halfLength; j++)
+      {
+        long n = center + j;
+        if (n >= 0 && n < (long)length) y += coeffs[j + halfLength] * data[n];
+      }
+    }
+    decimated[k] = y;
+  }
+
+  return decimated;
+}
+
+double refinePitch(const double* frame, int frameLength, int sampleRate, double pitch, int radius)
+{
+  if (pitch <= 0) return -1.0;
+
+  double guess = sampleRate / pitch;
+  int lower = std::max(1, (int)std::floor(guess) - radius);
+  int upper = std::min(frameLength - 2, (int)std::ceil(guess) + radius);
+  if (lower > upper) return pitch;
+
+  // NSDF over [lower-1, upper+1] for the parabolic interpolation.
+  std::vector<double> nsdf(upper + 2, 0.0);
+  for(int tau=lower-1; tau<=upper+1; tau++)
+  {
+    double r = 0.0, m = 0.0;
+    for(int j=0; j<frameLength-tau; j++)
+    {
+      r += frame[j] * frame[j+tau];
+      m += frame[j] * frame[j] + frame[j+tau] * frame[j+tau];
+    }
+    nsdf[tau] = (m > 0) ? 2 * r / m : 0.0;
+  }
+
+  int best = lower;
+  for(int tau=lower; tau<=upper; tau++)
+  {
+    if (nsdf[tau] > nsdf[best]) best = tau;
+  }
+
+  double s0 = nsdf[best-1], s1 = nsdf[best], s2 = nsdf[best+1];
+  double denominator = s0 - 2 * s1 + s2;
+  double lag = (denominator != 0) ? best + 0.5 * (s0 - s2) / denominator : best;
+
+  return sampleRate / lag;
+}
+
+int PitchTracker::getTrackerLength(int sampleRate, int ms)
+{
+  return (int)std::min((long long)INT_MAX / 4, (long long)sampleRate * ms / 1000);
+}
+
+PitchTracker::PitchTracker(int sampleRate, int msFrame, int msHop, int lookahead)
+  : m_sampleRate(sampleRate),
+    m_frameLength(getTrackerLength(sampleRate, msFrame)),
+    m_hopLength(std::max(1, getTrackerLength(sampleRate, msHop))),
+    m_lookahead(std::max(0, lookahead)),
+    m_analyzer(getTrackerLength(sampleRate, msFrame), sampleRate)
+{
+  m_buffer.reserve(2 * m_frameLength);
+}
+
+PitchTracker::~PitchTracker()
+{
+}
+
+void PitchTracker::reset()
+{
+  m_skip = 0;
+  m_buffer.clear();
+  m_trellis.clear();
+}
+
+double PitchTracker::transitionCost(const PitchCandidate &from, const PitchCandidate &to)
+{
+  bool fromVoiced = from.pitch > 0;
+  bool toVoiced = to.pitch > 0;
+  if (fromVoiced && toVoiced) return TRACKER_OCTAVE_COST * std::fabs(std::log2(to.pitch / from.pitch));
+  if (fromVoiced != toVoiced) return TRACKER_VOICING_COST;
+  return 0.0;
+}
+
+void PitchTracker::addFrame(const float* frame)
+{
+  TrellisFrame current;
+  m_analyzer.getCandidates(frame, current.candidates);
+
+  // The unvoiced state is cheap when no candidate is clear.
+  double clearest = 0.0;
+  for(size_t i=0; i<current.candidates.size(); i++) clearest = std::max(clearest, current.candidates[i].clarity);
+  current.candidates.push_back({ -1.0, clearest });
+
+  size_t nbCandidates = current.candidates.size();
+  current.costs.resize(nbCandidates);
+  current.backPointers.resize(nbCandidates, -1);
+
+  for(size_t i=0; i<nbCandidates; i++)
+  {
+    const PitchCandidate &candidate = current.candidates[i];
+    double localCost = (candidate.pitch > 0)
+                       ? 1.0 - candidate.clarity
+                       : std::max(0.0, candidate.clarity - TRACKER_VOICING_THRESHOLD) / (1.0 - TRACKER_VOICING_THRESHOLD);
+
+    if (m_trellis.empty())
+    {
+      current.costs[i] = localCost;
+      continue;
+    }
+
+    const TrellisFrame &previous = m_trellis.back();
+    double best = -1.0;
+    for(size_t j=0; j<previous.candidates.size(); j++)
+    {
+      double cost = previous.costs[j] + transitionCost(previous.candidates[j], candidate);
+      if (current.backPointers[i] < 0 || cost < best)
+      {
+        best = cost;
+        current.backPointers[i] = j;
+      }
+    }
+    current.costs[i] = best + localCost;
+  }
+
+  // Keep the accumulated costs small, only their differences matter.
+  double lowest = *std::min_element(current.costs.begin(), current.costs.end());
+  for(size_t i=0; i<nbCandidates; i++) current.costs[i] -= lowest;
+
+  m_trellis.push_back(current);
+}
+
+double PitchTracker::emitOldest()
+{
+  // Backtrack from the best candidate of the newest frame down to the oldest one.
+  const TrellisFrame &newest = m_trellis.back();
+  int state = std::min_element(newest.costs.begin(), newest.costs.end()) - newest.costs.begin();
+  for(size_t i=m_trellis.size()-1; i>0; i--) state = m_trellis[i].backPointers[state];
+
+  double pitch = m_trellis[0].candidates[state].pitch;
+
+  // The oldest frame leaves the window, the next one becomes the start of the trellis.
+  m_trellis.erase(m_trellis.begin());
+
+  return pitch;
+}
+
+void PitchTracker::process(const float* data, size_t length, std::vector<double> &pitches)
+{
+  // The samples of a gap between two frames (hop > frame) are dropped as they arrive.
+  size_t skipped = std::min(m_skip, length);
+  m_skip -= skipped;
+  m_buffer.insert(m_buffer.end(), data + skipped, data + length);
+
+  size_t offset = 0;
+  for(; offset + m_frameLength <= m_buffer.size(); offset += m_hopLength)
+  {
+    addFrame(m_buffer.data() + offset);
+    if ((int)m_trellis.size() > m_lookahead) pitches.push_back(emitOldest());
+  }
+
+  // Keep the overlap for the next chunk, or the rest of the gap to skip.
+  if (offset > m_buffer.size())
+  {
+    m_skip = offset - m_buffer.size();
+    m_buffer.clear();
+  }
+  else
+  {
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + offset);
+  }
+}
+
+void PitchTracker::flush(std::vector<double> &pitches)
+{
+  while(!m_trellis.empty()) pitches.push_back(emitOldest());
+  m_skip = 0;
+  m_buffer.clear();
+}
@@ -27,8 +27,36 @@ async function test() {
   console.log(await ap.detectPitch(audio.wavdataL, audio.samplerate, 'acorr'));
   console.log(await ap.detectPitch(audio.wavdataL, audio.samplerate, 'yin'));
   console.log(await ap.detectPitch(audio.wavdataL, audio.samplerate, 'mpm'));
+  console.log(await ap.detectPitch(audio.wavdataL, audio.samplerate, 'yin', { decimate: true }));
+  // male.wav is at 14.7 kHz (no decimation), at 44.1/48 kHz the estimator runs on every 5th/6th sample.
+  for (let rate of [44100, 48000]) {
+    let upsampled = await ap.resample(audio.wavdataL, audio.samplerate, rate);
+    let fullRate = await ap.detectPitch(upsampled.wavdata, rate, 'yin');
+    let decimated = await ap.detectPitch(upsampled.wavdata, rate, 'yin', { decimate: true });
+    console.log('decimated pitch', rate, Math.abs(decimated.pitch - fullRate.pitch) < 0.02 * fullRate.pitch);
+  }
+  console.log(await ap.detectPitch(audio.wavdataL, audio.samplerate, 'yin', { minF0: 75, maxF0: 400 }));
+  // 250 Hz with a strong 500 Hz harmonic: over 300-800 Hz the lag of 250 Hz is never searched, so mpm finds the harmonic (not -1).
+  let harmonic = new Float32Array(16000);
+  for (let i = 0; i < harmonic.length; i++) harmonic[i] = Math.sin(2 * Math.PI * 500 * i / 16000) + 0.8 * Math.sin(2 * Math.PI * 250 * i / 16000);
+  let fullRange = await ap.detectPitch(harmonic, 16000, 'mpm');
+  let highRange = await ap.detectPitch(harmonic, 16000, 'mpm', { minF0: 300, maxF0: 800 });
+  console.log('pitch range', Math.abs(fullRange.pitch - 250) < 3, Math.abs(highRange.pitch - 500) < 5);
   // console.log(ap.detectPitch(audio.wavdataL, audio.samplerate, 'goertzel'));
   // console.log(ap.detectPitch(audio.wavdataL, audio.samplerate, 'dft'));
+  console.log(await ap.detectPitchBatch([audio.wavdataL.subarray(0, 22050), audio.wavdataL.subarray(22050, 44100)], audio.samplerate, 'yin'));
+  console.log(await ap.detectPitchBatch(audio.wavdataL.subarray(0, 44100), audio.samplerate, 'yin', { offsets: [0, 22050] }));
+  console.log(await ap.detectPitchEnsemble(audio.wavdataL, audio.samplerate, ['acorr', 'yin', 'mpm']));
+  let tracker = new ap.PitchTracker(audio.samplerate, { frame: 40, hop: 10, lookahead: 2 });
+  console.log(tracker.latency, tracker.process(audio.wavdataL.subarray(0, 4096)), tracker.flush());
+  // A pure tone is as clear at every multiple of its period; the tracker must still follow the fundamental.
+  for (let f0 of [110, 150, 220, 300]) {
+    let sine = new Float32Array(32000);
+    for (let i = 0; i < sine.length; i++) sine[i] = 0.5 * Math.sin(2 * Math.PI * f0 * i / 16000);
+    let sineTracker = new ap.PitchTracker(16000, { frame: 40, hop: 10 });
+    let voiced = [...sineTracker.process(sine), ...sineTracker.flush()].filter(p => p > 0).sort((a, b) => a - b);
+    console.log('tracked sine', f0, Math.abs(voiced[voiced.length >> 1] - f0) < 3);
+  }
 
   let ampfreq = await ap.ampfreq(audio.wavdataL, audio.samplerate);
   // console.log('ampfreq=', ampfreq);
@@ -57,6 +85,26 @@ async function test() {
     console.log("The file was saved!");
   });
 
+  // Test the parallel PCM to AMR
+  let parallelAMR_data = await ap.pcm2amr(audio2.wavdataL, audio2.samplerate, 7, false, 0);
+  console.log(parallelAMR_data.data.length, encodedAMR_data.data.length);
+
+  // Test the streaming PCM to AMR
+  let amrEncoder = new ap.AmrEncoder(audio2.samplerate, 7);
+  let amrChunks = [amrEncoder.process(audio2.wavdataL.subarray(0, 4096)), amrEncoder.process(audio2.wavdataL.subarray(4096)), amrEncoder.flush()];
+  console.log(Buffer.concat(amrChunks).length, encodedAMR_data.data.length);
+
+  // Test the PCM to AMR-WB in all the modes, and decode it back (throws unless the AMR-WB encoder is built in)
+  try {
+    for (let mode = 0; mode <= 8; mode++) {
+      let encodedAMRWB_data = (await ap.pcm2amrwb(audio2.wavdataL, audio2.samplerate, mode)).data;
+      let decodedAMRWB = await ap.amr2pcm(encodedAMRWB_data);
+      console.log(mode, encodedAMRWB_data.subarray(0, 9).toString() == '#!AMR-WB\n', decodedAMRWB.samplerate, decodedAMRWB.pcm.length);
+    }
+  } catch (e) {
+    console.log(e.message);
+  }
+
   // Test the WAV to AMR
   fs.readFile("./wav/female.wav", async (err, data) => {
     let amr_data = await ap.wav2amr(data, 7);
@@ -64,6 +112,19 @@ async function test() {
       if (err) return console.log(err);
       console.log("The file was saved!");
     });
+    // With the DTX, the silence is sent as the SID and NO_DATA frames.
+    let amr_dtx_data = await ap.wav2amr(data, 7, true);
+    console.log(amr_dtx_data.data.length, amr_data.data.length);
+  });
+
+  // Test the AMR RTP payloads
+  fs.readFile("./wav/sample.amr", async function (err, data) {
+    if (err) throw err;
+    let rtpBuffer = Buffer.alloc(data.length * 2);
+    let packets = await ap.amrPacketize(data, 3, rtpBuffer);
+    let frames = Buffer.alloc(packets.sizes[0]);
+    let size = await ap.amrDepacketize(rtpBuffer.subarray(0, packets.sizes[0]), 16000, frames);
+    console.log(packets.sizes.length, packets.position, size);
   });
 
   // Test the AMR
@@ -73,10 +134,65 @@ async function test() {
     ap.saveAudio('sample.wav', pcm_data.pcm, pcm_data.pcm, pcm_data.samplerate, pcm_data.bitdepth, 1);
   });
 
+  console.log(await ap.configureAmrPool({ size: 32, warmUp: 8 }));
+
+  // Test the batch AMR decoding
+  let amr_batch = await ap.amr2pcmBatch([fs.readFileSync("./wav/sample.amr"), fs.readFileSync("./wav/pen_with_silence.amr")]);
+  console.log(amr_batch.offsets, amr_batch.samplerates);
+
+  // Test the AMR seek index
+  let amr_index = await ap.amrIndex(fs.readFileSync("./wav/sample.amr"), 50);
+  let amr_range = await ap.amrDecodeRange(fs.readFileSync("./wav/sample.amr"), 1000, 2000, { index: amr_index.index });
+  console.log(amr_index.duration, amr_range.pcm.length);
+
+  // Test the AMR editing
+  let amr_cut = await ap.amrCut(fs.readFileSync("./wav/sample.amr"), 1000, 2000);
+  let amr_spliced = await ap.amrSplice(fs.readFileSync("./wav/sample.amr"), 0, 0, amr_cut.data);
+  console.log(amr_cut.data.length, amr_spliced.data.length, (await ap.amrConcat([amr_cut.data, amr_cut.data])).data.length);
+
+  // Test the streaming AMR decoder
+  let amrDecoder = new ap.AmrDecoder();
+  fs.createReadStream("./wav/sample.amr", { highWaterMark: 100 })
+    .on('data', (chunk) => console.log(amrDecoder.samplerate, amrDecoder.process(chunk).length))
+    .on('end', () => amrDecoder.flush());
+  // Non-AMR input fails every time until flush(), it must never overrun the pending buffer.
+  let badDecoder = new ap.AmrDecoder();
+  let badData = Buffer.alloc(1000, 0x55);
+  for (let i = 0; i < 100; i++) {
+    try { badDecoder.process(badData); console.log('bad AMR data accepted'); } catch (e) { if (i == 99) console.log('bad AMR data', e.message); }
+  }
+  badDecoder.flush();
+
+  console.log(await ap.amrFrameErrors());
+
   // Test the mp3
   fs.readFile("./wav/t2.mp3", async function (err, data) {
     if (err) throw err;
     let pcm_data = await ap.mp32pcm(data, data.length);
+    // Decode it in parallel, and compare the samples with the serial decoder
+    // t2.mp3 holds 47 whole frames of 432 bytes (MPEG-2 layer III, 96 kbps, 16 kHz): repeat them to get several segments
+    let mp3_long = Buffer.concat(Array(12).fill(data.subarray(0, 47 * 432)));
+    // Set big_values > 288 in frame 300, which resets the decoder, and insert a gap 4 frames later:
+    // the decoder resyncs after the gap while the scan keeps the 4 frames, so it falls back to the serial decoder
+    let mp3_corrupted = Buffer.from(mp3_long);
+    mp3_corrupted[300 * 432 + 6] |= 0x07;
+    mp3_corrupted[300 * 432 + 7] |= 0xfc;
+    mp3_corrupted = Buffer.concat([mp3_corrupted.subarray(0, 304 * 432), Buffer.alloc(3), mp3_corrupted.subarray(304 * 432)]);
+    for (const mp3 of [data, mp3_long, mp3_corrupted]) {
+      let pcm_serial = await ap.mp32pcm(mp3);
+      let pcm_parallel = await ap.mp32pcm(mp3, { threads: 4 });
+      console.log(pcm_parallel.pcm.length == pcm_serial.pcm.length && pcm_parallel.pcm.every((v, i) => v == pcm_serial.pcm[i]));
+    }
+    let mp3_index = await ap.mp3Index(data, 10);
+    let mp3_range = await ap.mp3DecodeRange(data, 500, 1000, { index: mp3_index.index });
+    console.log(mp3_index.duration, mp3_range.pcm.length);
+    console.log(await ap.probe(data));
+    // Decode it chunk by chunk
+    let mp3Decoder = new ap.Mp3Decoder({ block: 1024 });
+    let mp3Chunks = [mp3Decoder.process(data.subarray(0, 1000)), mp3Decoder.process(data.subarray(1000)), mp3Decoder.flush()];
+    console.log(mp3Decoder.samplerate, mp3Chunks.reduce((n, pcm) => n + pcm.length, 0), pcm_data.pcm.length);
+    let pcm_file = await ap.mp32pcmFile("./wav/t2.mp3");
+    console.log(pcm_file.pcm.length == pcm_data.pcm.length, (await ap.amr2pcmFile("./wav/sample.amr")).samplerate);
     ap.saveAudio('t2.wav', pcm_data.pcm, pcm_data.pcm, pcm_data.samplerate, pcm_data.bitdepth, 1);
   });
 